@@ -1,7 +1,9 @@
 #define _GNU_SOURCE
 #include "bench.h"
+#include "tbcounters.h"
 #include <err.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <math.h>
 #include <pthread.h>
@@ -32,13 +34,22 @@ static int idle_thread = -1;
 // ID of first spawned benchmark thread
 static int first_thread_id = -1;
 static bool demos_enabled = false;
+static struct tb_counters *counters;
 
 int loops_per_print = 1000000;
+static bool timestamp = false;
 
 void *benchmark_loop(void *ptr)
 {
     int thread_id = (intptr_t)ptr;
     uint64_t cpu_work_done = 0;
+    uint64_t *counter = NULL;
+
+    if (counters) {
+        char name[TB_COUNTER_NAME_MAX];
+        snprintf(name, sizeof(name), "CPU%d_work_done", thread_id);
+        counter = tb_counter_add(counters, name);
+    }
 
     while (1) {
         for (int j = 0; j < loops_per_print || loops_per_print < 1; ++j) {
@@ -51,9 +62,15 @@ void *benchmark_loop(void *ptr)
                 pthread_mutex_unlock(&mutex);
             }
             cpu_work_done += bench_func();
+            tb_counter_set(counter, cpu_work_done);
+        }
+        if (!counter) {
+            if (timestamp)
+                printf("CPU%d_work_done@%" PRIu64 "=%lu\n", thread_id, tb_timestamp_ns(), cpu_work_done);
+            else
+                printf("CPU%d_work_done=%lu\n", thread_id, cpu_work_done);
+            fflush(stdout);
         }
-        printf("CPU%d_work_done=%lu\n", thread_id, cpu_work_done);
-        fflush(stdout);
         // seems most sensible after printf, so that we see the progress before suspending
         if (demos_enabled && thread_id == first_thread_id) {
             demos_completed();
@@ -102,7 +119,7 @@ int main(int argc, char *argv[])
     long period_ms = 0;
     long utilization_ratio = 100;
 
-    while ((opt = getopt(argc, argv, "l:m:p:u:")) != -1) {
+    while ((opt = getopt(argc, argv, "l:m:p:tu:")) != -1) {
         switch (opt) {
         case 'l':
             loops_per_print = xstrtol(optarg, "-l");
@@ -113,11 +130,14 @@ int main(int argc, char *argv[])
         case 'p':
             period_ms = xstrtol(optarg, "-p");
             break;
+        case 't':
+            timestamp = true;
+            break;
         case 'u':
             utilization_ratio = xstrtol(optarg, "-u");
             break;
         default: /* '?' */
-            fprintf(stderr, "Usage: %s [-l loops ] [-m cpu_mask]\n", argv[0]);
+            fprintf(stderr, "Usage: %s [-l loops ] [-m cpu_mask] [-t]\n", argv[0]);
             exit(1);
         }
     }
@@ -136,6 +156,8 @@ int main(int argc, char *argv[])
     }
 #endif
 
+    counters = tb_counters_open();
+
     for (int i = 0; i < num_proc; i++) {
         pthread_attr_t attr;
         cpu_set_t cpuset;
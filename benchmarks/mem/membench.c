@@ -5,6 +5,7 @@
 /**********************************************/
 
 #define _GNU_SOURCE
+#include "tbcounters.h"
 #include <assert.h>
 #include <err.h>
 #include <pthread.h>
@@ -207,6 +208,7 @@ pthread_barrier_t barrier;
 struct s array[MAX_CPUS][64*0x100000/sizeof(struct s)] __attribute__ ((aligned (2*1024*1024)));
 
 bool print = true;
+struct tb_counters *counters;
 
 static void *benchmark_thread(void *arg)
 {
@@ -227,6 +229,12 @@ static void *benchmark_thread(void *arg)
 		fprintf(stderr, "CPU %d starts measurement\n", me->cpu);
 
         unsigned work_done = 0;
+        uint64_t *counter = NULL;
+        if (me->cfg->forever && counters) {
+                char name[TB_COUNTER_NAME_MAX];
+                snprintf(name, sizeof(name), "CPU%d_work_done", me->cpu);
+                counter = tb_counter_add(counters, name);
+        }
         do {
                 uint64_t tic, tac;
                 tic = get_time(me->cfg);
@@ -238,7 +246,10 @@ static void *benchmark_thread(void *arg)
                 tac = get_time(me->cfg);
                 me->result = (double)(tac - tic) / me->cfg->read_count;
                 if (me->cfg->forever) {
-                        printf("CPU%d_work_done=%u\n", me->cpu, work_done++);
+                        if (counter)
+                                tb_counter_set(counter, work_done++);
+                        else
+                                printf("CPU%d_work_done=%u\n", me->cpu, work_done++);
                         printf("CPU%d size:%d time:%g\n", me->cpu, me->cfg->size, (tac - tic) / 1000000000.0);
 			fflush(stdout);
                 }
@@ -418,6 +429,8 @@ int main(int argc, char *argv[])
 	if (cfg.use_cycles)
 		ccntr_init();
 
+	counters = tb_counters_open();
+
 	if (cfg.size != 0) {
 		run_benchmark(&cfg);
 	} else {
@@ -0,0 +1,123 @@
+#ifndef TBCOUNTERS_H
+#define TBCOUNTERS_H
+
+/*
+
+Shared-memory counters for reporting benchmark progress to Thermobench.
+
+Printing "KEY=value" lines to stdout costs system calls and contends on
+the stdio lock, which perturbs the measured workload. Instead, a
+benchmark run by "thermobench --counters" can register named 64-bit
+counters and update them with plain (relaxed atomic) stores.
+Thermobench samples all counters every --period and stores their values
+to the --column of the same name.
+
+Usage:
+
+    struct tb_counters *c = tb_counters_open(); // NULL when not run by thermobench
+    uint64_t *work_done = tb_counter_add(c, "CPU0_work_done");
+    ...
+    tb_counter_set(work_done, ++n); // No-op when work_done is NULL
+
+Thermobench passes the path of the shared-memory region in the
+THERMOBENCH_COUNTERS environment variable. The region starts with
+struct tb_counters. Counters are allocated by incrementing the count
+field atomically. A counter becomes visible to thermobench when its
+ready field is set (with release semantics) after its name is written.
+
+Values that are still printed can carry the time when they were
+produced as "KEY@NS=value", where NS is tb_timestamp_ns(). Thermobench
+then stores them with this time rather than with the (later) time when
+it read the line from the pipe.
+
+*/
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TB_COUNTERS_ENV "THERMOBENCH_COUNTERS"
+#define TB_COUNTERS_MAGIC 0x54424354 /* "TBCT" */
+#define TB_COUNTERS_VERSION 1
+#define TB_COUNTERS_MAX 256
+#define TB_COUNTER_NAME_MAX 48 /* Including the terminating NUL */
+
+/* Every counter occupies its own cache line */
+struct tb_counter {
+    char name[TB_COUNTER_NAME_MAX];
+    uint32_t ready;
+    uint32_t reserved;
+    uint64_t value;
+};
+
+struct tb_counters {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t count; /* Allocated counters, may exceed capacity */
+    uint32_t reserved[12];
+    struct tb_counter counter[TB_COUNTERS_MAX];
+};
+
+/* Map the counters region, return NULL if not run by thermobench */
+static inline struct tb_counters *tb_counters_open(void)
+{
+    const char *path = getenv(TB_COUNTERS_ENV);
+    if (!path)
+        return NULL;
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    void *p = mmap(NULL, sizeof(struct tb_counters), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+    struct tb_counters *c = (struct tb_counters *)p;
+    if (c->magic != TB_COUNTERS_MAGIC || c->version != TB_COUNTERS_VERSION) {
+        munmap(p, sizeof(struct tb_counters));
+        return NULL;
+    }
+    return c;
+}
+
+/* Register a counter, return NULL if c is NULL or the region is full */
+static inline uint64_t *tb_counter_add(struct tb_counters *c, const char *name)
+{
+    if (!c)
+        return NULL;
+    uint32_t idx = __atomic_fetch_add(&c->count, 1, __ATOMIC_RELAXED);
+    if (idx >= c->capacity)
+        return NULL;
+    struct tb_counter *counter = &c->counter[idx];
+    memcpy(counter->name, name, strnlen(name, TB_COUNTER_NAME_MAX - 1)); /* The rest is zeroed */
+    __atomic_store_n(&counter->ready, 1, __ATOMIC_RELEASE);
+    return &counter->value;
+}
+
+static inline void tb_counter_set(uint64_t *counter, uint64_t value)
+{
+    if (counter)
+        __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+/* CLOCK_MONOTONIC time in nanoseconds for KEY@NS=value lines */
+static inline uint64_t tb_timestamp_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,7 +1,9 @@
 #include "tbwrap.h"
+#include "tbcounters.h"
 #include <argp.h>
 #include <argz.h>
 #include <err.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -18,6 +20,10 @@ information. For example:
 
     TB_OPTS="--help" ./tacle_bench_kernel_binarysearch
 
+When run by "thermobench --counters", the work_done value is published
+via shared memory (see tbcounters.h) after every iteration instead of
+being printed.
+
 */
 
 struct arguments {
@@ -26,6 +32,7 @@ struct arguments {
     uint64_t work_done_every;
     uint64_t work_done_every_msec;
     bool time;
+    bool timestamp;
 };
 
 /* Program documentation. */
@@ -39,10 +46,11 @@ static char args_doc[] = "";
 // clang-format off
 static struct argp_option options[] = {
     {"count",           'c', "NUM",   0, "Execute the benchmark NUM times. Zero means infinity. Defaults to 1." },
-    {"work_done_str",   'w', "STR",   0, "\"work_done\" prefix string. Empty (default) means don't print the work_done message" },
+    {"work_done_str",   'w', "STR",   0, "\"work_done\" prefix string. Empty (default) means don't print the work_done message. With thermobench --counters, name of the counter (default: work_done)." },
     {"work_done_every", 'e', "NUM",   0, "Print \"work_done\" message every NUM iterations. Defaults to 1." },
     {"work_done_every_sec", 's', "NUM",   0, "Print \"work_done\" approximately every NUM seconds. When non-zero, overrides --work_done_every." },
     {"time",            't', 0,       0, "Measure and print execution time of the benchmark." },
+    {"timestamp",       'T', 0,       0, "Print messages as KEY@NS=value, where NS is the CLOCK_MONOTONIC time in nanoseconds, so that thermobench stores them with the time they were produced." },
 
     { 0 }
 };
@@ -71,6 +79,9 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
     case 't':
         arguments->time = true;
         break;
+    case 'T':
+        arguments->timestamp = true;
+        break;
     case ARGP_KEY_ARG:
         return ARGP_ERR_UNKNOWN;
     default:
@@ -149,10 +160,19 @@ static bool print_work_done_now()
     return false;
 }
 
+static uint64_t *work_done_counter;
+
 static void print_work_done(uint64_t work_done)
 {
+    if (work_done_counter) {
+        tb_counter_set(work_done_counter, work_done);
+        return;
+    }
     if (arguments.work_done_str && print_work_done_now()) {
-        printf("%s=%lu\n", arguments.work_done_str, work_done);
+        if (arguments.timestamp)
+            printf("%s@%" PRIu64 "=%lu\n", arguments.work_done_str, tb_timestamp_ns(), work_done);
+        else
+            printf("%s=%lu\n", arguments.work_done_str, work_done);
         fflush(stdout);
     }
 }
@@ -172,7 +192,9 @@ static void tac(struct tictac *t)
 
     uint64_t ns = +t->tac.tv_sec * 1000000000 + t->tac.tv_nsec - t->tic.tv_sec * 1000000000 - t->tic.tv_nsec;
 
-    if (arguments.time)
+    if (arguments.time && arguments.timestamp)
+        printf("time@%" PRIu64 "=%g s\n", tb_timestamp_ns(), (double)ns / 1000000000.0);
+    else if (arguments.time)
         printf("time=%g s\n", (double)ns / 1000000000.0);
 }
 
@@ -182,6 +204,9 @@ void thermobench_wrap(void (*f)())
 
     parse_tb_opts();
 
+    work_done_counter
+        = tb_counter_add(tb_counters_open(), arguments.work_done_str ? arguments.work_done_str : "work_done");
+
     tic(&tictac);
 
     uint64_t i;
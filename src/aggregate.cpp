@@ -0,0 +1,226 @@
+#include "aggregate.h"
+#include <err.h>
+#include <iterator>
+#include <stdlib.h>
+
+static const struct {
+    AggFunc func;
+    const char *name;
+} agg_func_names[] = {
+    { AggFunc::LAST, "last" }, { AggFunc::MIN, "min" }, { AggFunc::MAX, "max" },
+    { AggFunc::MEAN, "mean" }, { AggFunc::SUM, "sum" }, { AggFunc::COUNT, "count" },
+};
+
+AggFunc parseAggFunc(const string &name)
+{
+    for (const auto &f : agg_func_names)
+        if (name == f.name)
+            return f.func;
+    errx(1, "Unknown aggregate function: %s", name.c_str());
+}
+
+bool isAggFunc(const string &name)
+{
+    for (const auto &f : agg_func_names)
+        if (name == f.name)
+            return true;
+    return false;
+}
+
+const char *aggFuncName(AggFunc func)
+{
+    for (const auto &f : agg_func_names)
+        if (func == f.func)
+            return f.name;
+    return "?";
+}
+
+vector<AggFunc> parseAggFuncs(const string &list)
+{
+    vector<AggFunc> funcs;
+    size_t start = 0, end;
+    do {
+        end = list.find(',', start);
+        funcs.push_back(parseAggFunc(list.substr(start, end - start)));
+        start = end + 1;
+    } while (end != string::npos);
+    return funcs;
+}
+
+/* Accumulator implementation */
+
+void Accumulator::add(const CsvCell &cell)
+{
+    if (cell.text.empty())
+        return;
+    last = cell.text;
+    addNumber(cell.number);
+}
+
+CsvCell::Type Accumulator::addUnescaped(string_view value)
+{
+    if (value.empty())
+        return CsvCell::TEXT;
+    last.clear();
+    csvEscapeAppend(last, value);
+
+    int64_t integer;
+    double number;
+    CsvCell::Type type = parseNumber(value, integer, number);
+    addNumber(number);
+    return type;
+}
+
+void Accumulator::addNumber(double v)
+{
+    if (isnan(v))
+        return; // Not a number
+    count++;
+    sum += v;
+    if (v < min)
+        min = v;
+    if (v > max)
+        max = v;
+}
+
+void Accumulator::reset()
+{
+    *this = Accumulator();
+}
+
+void Accumulator::set(CsvRow &row, const CsvColumn &column, AggFunc f) const
+{
+    if (f == AggFunc::LAST) {
+        row.setEscaped(column, last);
+        return;
+    }
+    if (count == 0)
+        return;
+
+    switch (f) {
+    case AggFunc::MIN:
+        row.setExact(column, min);
+        break;
+    case AggFunc::MAX:
+        row.setExact(column, max);
+        break;
+    case AggFunc::MEAN:
+        row.set(column, sum / count);
+        break;
+    case AggFunc::SUM:
+        row.setExact(column, sum);
+        break;
+    case AggFunc::COUNT:
+        row.set(column, to_string(count));
+        break;
+    case AggFunc::LAST:
+        break;
+    }
+}
+
+/* Aggregator implementation */
+
+string aggHeader(const string &header, AggFunc f)
+{
+    size_t slash = header.find('/');
+    string name = header.substr(0, slash) + "_" + aggFuncName(f);
+    return (slash == string::npos || f == AggFunc::COUNT) ? name : name + header.substr(slash);
+}
+
+Aggregator::Aggregator(const CsvColumns &src_columns, const CsvColumn &src_time, double window_ms,
+                       const vector<AggFunc> &default_funcs, const Specs &specs)
+    : time_column(columns.add(src_time.getHeader()))
+    , src_columns(src_columns)
+    , src_time(src_time)
+    , window_ms(window_ms)
+    , default_funcs(default_funcs)
+    , specs(specs)
+{
+    addSources();
+
+    for (const auto &spec : specs) {
+        const CsvColumn *col = src_columns.find(spec.first);
+        if (!col || col == &src_time)
+            errx(1, "--aggregate: Unknown column: %s", spec.first.c_str());
+    }
+}
+
+// Create sources for the columns added since the last call
+void Aggregator::addSources()
+{
+    auto col = src_columns.begin();
+    advance(col, src_count);
+    for (; col != src_columns.end(); ++col, ++src_count) {
+        if (&*col == &src_time)
+            continue;
+
+        const string &header = col->getHeader();
+        auto spec = specs.find(header);
+        if (spec == specs.end())
+            spec = specs.find(header.substr(0, header.find('/')));
+
+        auto src = make_unique<Source>();
+        for (AggFunc f : spec != specs.end() ? spec->second : default_funcs)
+            src->outputs.push_back({ f, columns.add(aggHeader(header, f)) });
+
+        if (sources.size() <= col->getOrder())
+            sources.resize(col->getOrder() + 1);
+        sources[col->getOrder()] = move(src);
+    }
+}
+
+void Aggregator::add(const CsvRow &row, CsvOutput &out)
+{
+    double time = row.getNumber(src_time.getOrder());
+    double start = floor(time / window_ms) * window_ms;
+
+    while (!windows.empty() && windows.front().start < start - window_ms) {
+        emit(out, windows.front());
+        windows.pop_front();
+    }
+
+    if (src_count < src_columns.count())
+        addSources();
+    Window &w = window(start);
+    if (w.accs.size() < sources.size())
+        w.accs.resize(sources.size());
+    for (unsigned order : row.getFilled()) {
+        if (order < sources.size() && sources[order])
+            w.accs[order].add(row.getCell(order));
+    }
+}
+
+// Return the open window starting at start. Rows too late for their
+// window are added to the oldest open one.
+Aggregator::Window &Aggregator::window(double start)
+{
+    if (!windows.empty() && start < windows.front().start)
+        return windows.front();
+    auto w = windows.begin();
+    while (w != windows.end() && w->start < start)
+        ++w;
+    if (w == windows.end() || w->start != start)
+        w = windows.insert(w, { start, vector<Accumulator>(sources.size()) });
+    return *w;
+}
+
+void Aggregator::finish(CsvOutput &out)
+{
+    for (const Window &w : windows)
+        emit(out, w);
+    windows.clear();
+}
+
+void Aggregator::emit(CsvOutput &out, const Window &w)
+{
+    CsvRow row(columns);
+    row.setExact(time_column, w.start); // Large times must remain distinct
+    for (unsigned order = 0; order < sources.size() && order < w.accs.size(); order++) {
+        const Accumulator &acc = w.accs[order];
+        if (!sources[order] || acc.empty())
+            continue;
+        for (const Output &o : sources[order]->outputs)
+            acc.set(row, o.column, o.func);
+    }
+    out.write(row);
+}
@@ -0,0 +1,101 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include "csvOutput.h"
+#include "csvRow.h"
+#include <deque>
+#include <map>
+#include <math.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class AggFunc { LAST, MIN, MAX, MEAN, SUM, COUNT };
+
+AggFunc parseAggFunc(const string &name);
+bool isAggFunc(const string &name);
+const char *aggFuncName(AggFunc f);
+vector<AggFunc> parseAggFuncs(const string &list);
+// Insert the function name before the unit, e.g. temp/°C -> temp_max/°C
+string aggHeader(const string &header, AggFunc f);
+
+// Accumulates values of a single column. Numeric statistics are
+// calculated only from values that can be parsed as numbers (NaN
+// values are ignored).
+struct Accumulator {
+    unsigned count = 0;
+    double sum = 0;
+    double min = INFINITY;
+    double max = -INFINITY;
+    string last = {};
+
+    // Add a cell of a CsvRow
+    void add(const CsvCell &cell);
+    // Add an unescaped value (e.g. from a KEY=value line) and return
+    // its type
+    CsvCell::Type addUnescaped(string_view value);
+    void reset();
+    bool empty() const { return last.empty(); }
+
+    // Store the aggregated value to the row
+    void set(CsvRow &row, const CsvColumn &column, AggFunc f) const;
+
+private:
+    void addNumber(double v);
+};
+
+// Aggregates rows over consecutive time windows and emits one row per
+// window. Every column of the source rows (except time) is aggregated
+// by one or more functions, each of which produces one output column.
+// Columns added to the source later are aggregated too.
+class Aggregator {
+public:
+    using Specs = map<string, vector<AggFunc>>;
+
+    Aggregator(const CsvColumns &src_columns, const CsvColumn &src_time, double window_ms,
+               const vector<AggFunc> &default_funcs, const Specs &specs);
+
+    Aggregator(const Aggregator &) = delete;
+    void operator=(const Aggregator &) = delete;
+
+    // Accumulate the row in the window of its time. Windows are
+    // written to out one window late, so that rows with producer
+    // timestamps (KEY@NS=value), which may arrive after rows with
+    // later times, still get into their window.
+    void add(const CsvRow &row, CsvOutput &out);
+
+    // Write the remaining windows
+    void finish(CsvOutput &out);
+
+    CsvColumns columns = {};
+    const CsvColumn &time_column;
+
+private:
+    struct Output {
+        AggFunc func;
+        const CsvColumn &column;
+    };
+    struct Source {
+        vector<Output> outputs = {};
+    };
+    struct Window {
+        double start;
+        vector<Accumulator> accs; // Indexed by source column order
+    };
+
+    const CsvColumns &src_columns;
+    const CsvColumn &src_time;
+    const double window_ms;
+    const vector<AggFunc> default_funcs;
+    const Specs specs;
+    vector<unique_ptr<Source>> sources = {}; // Indexed by source column order
+    size_t src_count = 0; // Number of src_columns with sources
+    deque<Window> windows = {}; // Not yet written, oldest first
+
+    void addSources();
+    Window &window(double start);
+    void emit(CsvOutput &out, const Window &w);
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "capture.h"
+#include <err.h>
+#include <string.h>
+
+static const char magic[8] = { 'T', 'B', 'C', 'A', 'P', 0, 0, 1 };
+
+CaptureWriter::CaptureWriter(const string &file)
+    : file(file)
+    , fp(fopen(file.c_str(), "w"))
+{
+    if (!fp)
+        err(1, "fopen(%s)", file.c_str());
+    setvbuf(fp, NULL, _IOFBF, 0x10000);
+    fwrite(magic, sizeof(magic), 1, fp);
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    if (fclose(fp) != 0)
+        warn("fclose(%s)", file.c_str());
+}
+
+void CaptureWriter::write(CaptureRecord::Type type, unsigned source, double time, const void *data, size_t length)
+{
+    CaptureRecord::Header hdr = { type, 0, uint16_t(source), uint32_t(length), time };
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 || fwrite(data, 1, length, fp) != length)
+        err(1, "fwrite(%s)", file.c_str());
+}
+
+void CaptureWriter::flush()
+{
+    fflush(fp);
+}
+
+CaptureReader::CaptureReader(const string &file)
+    : file(file)
+    , fp(fopen(file.c_str(), "r"))
+{
+    if (!fp)
+        err(1, "fopen(%s)", file.c_str());
+    char buf[sizeof(magic)];
+    if (fread(buf, sizeof(buf), 1, fp) != 1 || memcmp(buf, magic, sizeof(magic)) != 0)
+        errx(1, "%s: Not a thermobench capture file", file.c_str());
+}
+
+CaptureReader::~CaptureReader()
+{
+    fclose(fp);
+}
+
+bool CaptureReader::next(CaptureRecord &rec)
+{
+    if (fread(&rec.hdr, sizeof(rec.hdr), 1, fp) != 1)
+        return false;
+    rec.data.resize(rec.hdr.length);
+    if (fread(&rec.data[0], 1, rec.hdr.length, fp) != rec.hdr.length) {
+        // Capture of a crashed run can end with incomplete record
+        warnx("%s: Truncated record", file.c_str());
+        return false;
+    }
+    return true;
+}
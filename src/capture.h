@@ -0,0 +1,78 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+using namespace std;
+
+// Binary log of raw measurement inputs, which allows regenerating the
+// CSV with a different configuration (see --replay).
+//
+// The file starts with an 8-byte magic followed by records, each
+// consisting of a fixed header (CaptureRecord::Header, native byte
+// order) and a payload of header.length bytes.
+struct CaptureRecord {
+    enum Type : uint8_t {
+        COMMENT, // Payload: CSV header comment
+        SENSOR_DEF, // Source: sensor index, payload: sensor SPEC
+        EXEC_DEF, // Source: --exec index, payload: command
+        SOCKET_DEF, // Source: --socket index, payload: path
+        TICK, // Periodic measurement, payload: double value of every sensor and CPU load
+        STDOUT, // Source: 0 for COMMAND or --corun index + 1, payload: chunk of its stdout
+        EXEC, // Source: --exec index, payload: chunk of its stdout
+        SOCKET, // Source: --socket index, payload: chunk of received data
+        COUNTERS, // Shared-memory counters sampled with the next TICK, payload: NAME=value lines
+        START, // Payload: struct timespec of CLOCK_MONOTONIC at time 0
+        CORUN_DEF, // Source: --corun index + 1, payload: PREFIX
+    };
+    struct Header {
+        Type type;
+        uint8_t reserved;
+        uint16_t source;
+        uint32_t length;
+        double time; // [ms]
+    };
+
+    Header hdr = {};
+    string data = {};
+};
+
+class CaptureWriter {
+public:
+    CaptureWriter(const string &file);
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter &) = delete;
+    void operator=(const CaptureWriter &) = delete;
+
+    void write(CaptureRecord::Type type, unsigned source, double time, const void *data, size_t length);
+    void write(CaptureRecord::Type type, unsigned source, double time, const string &data)
+    {
+        write(type, source, time, data.data(), data.size());
+    }
+    void flush();
+
+private:
+    const string file;
+    FILE *fp;
+};
+
+class CaptureReader {
+public:
+    CaptureReader(const string &file);
+    ~CaptureReader();
+
+    CaptureReader(const CaptureReader &) = delete;
+    void operator=(const CaptureReader &) = delete;
+
+    // Read the next record, return false at the end of file
+    bool next(CaptureRecord &rec);
+
+private:
+    const string file;
+    FILE *fp;
+};
+
+#endif
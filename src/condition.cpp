@@ -0,0 +1,61 @@
+#include "condition.h"
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+Condition Condition::parse(const string &spec, const CsvColumns &columns)
+{
+    static const struct {
+        const char *str;
+        Op op;
+    } ops[] = {
+        // Two-character operators first
+        { "<=", LE }, { ">=", GE }, { "==", EQ }, { "!=", NE }, { "<", LT }, { ">", GT }, { "=", EQ },
+    };
+
+    size_t pos = spec.find_first_of("<>=!");
+    if (pos == string::npos || pos == 0)
+        errx(1, "Invalid condition: %s", spec.c_str());
+
+    for (const auto &o : ops) {
+        if (spec.compare(pos, strlen(o.str), o.str) != 0)
+            continue;
+
+        const string name = spec.substr(0, pos);
+        const CsvColumn *column = columns.find(name);
+        if (!column)
+            errx(1, "Unknown column in condition: %s", spec.c_str());
+
+        const string num = spec.substr(pos + strlen(o.str));
+        char *end;
+        double value = strtod(num.c_str(), &end);
+        if (num.empty() || *end != '\0')
+            errx(1, "Invalid number in condition: %s", spec.c_str());
+
+        return Condition(*column, o.op, value, spec);
+    }
+    errx(1, "Invalid condition: %s", spec.c_str());
+}
+
+bool Condition::eval(const CsvRow &row) const
+{
+    double v = row.getNumber(column.getOrder());
+    if (isnan(v))
+        return false;
+
+    switch (op) {
+    case LT:
+        return v < value;
+    case LE:
+        return v <= value;
+    case GT:
+        return v > value;
+    case GE:
+        return v >= value;
+    case EQ:
+        return v == value;
+    case NE:
+        return v != value;
+    }
+    return false;
+}
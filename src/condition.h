@@ -0,0 +1,33 @@
+#ifndef CONDITION_H
+#define CONDITION_H
+
+#include "csvRow.h"
+#include <string>
+
+// Comparison of a column value with a constant, e.g. CPU_0_temp>95000
+struct Condition {
+    enum Op { LT, LE, GT, GE, EQ, NE };
+
+    const CsvColumn &column;
+    const Op op;
+    const double value;
+    const string spec;
+
+    // COL is the column header, optionally without the unit
+    static Condition parse(const string &spec, const CsvColumns &columns);
+
+    // True if the row contains a value of the column and the
+    // comparison holds
+    bool eval(const CsvRow &row) const;
+
+private:
+    Condition(const CsvColumn &column, Op op, double value, const string &spec)
+        : column(column)
+        , op(op)
+        , value(value)
+        , spec(spec)
+    {
+    }
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include "counters.h"
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+SharedCounters::SharedCounters()
+    : fd(memfd_create("thermobench-counters", MFD_CLOEXEC))
+    , region(nullptr)
+    , region_path("/proc/" + to_string(getpid()) + "/fd/" + to_string(fd))
+{
+    if (fd == -1)
+        err(1, "memfd_create");
+    if (ftruncate(fd, sizeof(struct tb_counters)) == -1)
+        err(1, "ftruncate");
+    void *p = mmap(NULL, sizeof(struct tb_counters), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        err(1, "mmap");
+    region = static_cast<struct tb_counters *>(p);
+    region->capacity = TB_COUNTERS_MAX;
+    region->version = TB_COUNTERS_VERSION;
+    region->magic = TB_COUNTERS_MAGIC;
+}
+
+SharedCounters::~SharedCounters()
+{
+    munmap(region, sizeof(struct tb_counters));
+    close(fd);
+}
+
+void SharedCounters::read(string &out) const
+{
+    uint32_t count = __atomic_load_n(&region->count, __ATOMIC_RELAXED);
+    if (count > TB_COUNTERS_MAX) // Do not trust region->capacity
+        count = TB_COUNTERS_MAX;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const struct tb_counter &c = region->counter[i];
+        if (!__atomic_load_n(&c.ready, __ATOMIC_ACQUIRE))
+            continue;
+        char line[TB_COUNTER_NAME_MAX + 24];
+        int len = snprintf(line, sizeof(line), "%.*s=%" PRIu64 "\n", TB_COUNTER_NAME_MAX - 1, c.name,
+                           __atomic_load_n(&c.value, __ATOMIC_RELAXED));
+        out.append(line, len);
+    }
+}
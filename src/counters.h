@@ -0,0 +1,32 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include "tbcounters.h"
+#include <string>
+
+using namespace std;
+
+// Shared-memory region where the COMMAND publishes its counters (see
+// benchmarks/tbcounters.h). The region is an anonymous memory file
+// reachable via /proc by the COMMAND and all its descendants.
+class SharedCounters {
+public:
+    SharedCounters();
+    ~SharedCounters();
+
+    SharedCounters(const SharedCounters &) = delete;
+    void operator=(const SharedCounters &) = delete;
+
+    // Value of the TB_COUNTERS_ENV environment variable
+    const string &path() const { return region_path; }
+
+    // Append "NAME=value\n" line for every registered counter to out
+    void read(string &out) const;
+
+private:
+    int fd;
+    struct tb_counters *region;
+    string region_path;
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include "csvOutput.h"
+#include <err.h>
+#include <fcntl.h>
+#include <iterator>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void CsvOutput::setRotation(off_t max_bytes, double max_ms)
+{
+    rotate_bytes = max_bytes;
+    rotate_ms = max_ms;
+}
+
+void CsvOutput::open(const char *file)
+{
+    this->file = file;
+    if (this->file == "-") {
+        if (rotate_bytes > 0 || rotate_ms > 0)
+            errx(1, "Output rotation is not supported with standard output");
+        fp = fdopen(STDOUT_FILENO, "w");
+        if (fp == NULL)
+            err(1, "open(%s)", file);
+    } else {
+        openSegment();
+    }
+}
+
+string CsvOutput::segmentName(unsigned segment) const
+{
+    if (rotate_bytes == 0 && rotate_ms == 0)
+        return file;
+
+    // Insert the segment number before the extension: data.csv -> data.0000.csv
+    char num[20];
+    snprintf(num, sizeof(num), ".%04u", segment);
+    size_t dot = file.rfind('.');
+    if (dot == string::npos || file.find('/', dot) != string::npos)
+        return file + num;
+    return file.substr(0, dot) + num + file.substr(dot);
+}
+
+void CsvOutput::openSegment()
+{
+    const string name = segmentName(segment);
+    fp = fopen(name.c_str(), "w+");
+    if (fp == NULL)
+        err(1, "open(%s)", name.c_str());
+
+    // Reserve space for the whole segment to reduce fragmentation.
+    // When rotating by time, the previous segment size is our best
+    // guess. Failures (e.g. unsupported by the file system) are not
+    // fatal.
+    off_t size = rotate_bytes > 0 ? rotate_bytes : prealloc;
+    if (size > 0)
+        fallocate(fileno(fp), FALLOC_FL_KEEP_SIZE, 0, size);
+}
+
+void CsvOutput::closeSegment()
+{
+    fflush(fp);
+    // Release the preallocated space beyond the end of data
+    off_t size = ftello(fp);
+    if (size > prealloc)
+        prealloc = size;
+    struct stat st;
+    bool regular = fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode);
+    if (regular && ftruncate(fileno(fp), size) == -1)
+        warn("ftruncate(%s)", segmentName(segment).c_str());
+    if (regular && format == WIDE && header_columns < columns.count())
+        rewriteHeader();
+    fclose(fp);
+    fp = nullptr;
+}
+
+void CsvOutput::writeHeader(const string &comment)
+{
+    header_comment = comment;
+    writeHeaderLines();
+}
+
+void CsvOutput::writeHeaderLines()
+{
+    writeComment(header_comment);
+
+    switch (format) {
+    case WIDE: {
+        CsvRow row(columns);
+        columns.setHeader(row);
+        row.write(fp);
+        break;
+    }
+    case LONG:
+        for (const CsvColumn &column : columns) {
+            if (&column != &time_column)
+                writeColumnLine(column);
+        }
+        fprintf(fp, "%s,column,value\n", csvEscape(time_column.getHeader()).c_str());
+        break;
+    }
+    listed_columns = header_columns = columns.count();
+    data_start = ftello(fp);
+}
+
+void CsvOutput::writeColumnLine(const CsvColumn &column)
+{
+    fprintf(fp, "# column %u: %s\n", column.getOrder(), csvEscape(column.getHeader()).c_str());
+}
+
+void CsvOutput::listNewColumns()
+{
+    auto column = columns.begin();
+    advance(column, listed_columns);
+    for (; column != columns.end(); ++column)
+        writeColumnLine(*column);
+    listed_columns = columns.count();
+}
+
+// Copy the rows of the current segment to a new file starting with
+// the complete header and replace the segment with it. Rows written
+// before the last columns were created are padded with empty cells.
+void CsvOutput::rewriteHeader()
+{
+    const string name = segmentName(segment);
+    const string tmp = name + ".tmp";
+    FILE *data = fp;
+    off_t start = data_start;
+
+    fp = fopen(tmp.c_str(), "w");
+    if (fp == NULL) {
+        warn("open(%s)", tmp.c_str());
+        fp = data;
+        return;
+    }
+    writeHeaderLines();
+
+    char buf[0x10000];
+    size_t len;
+    string out;
+    const unsigned width = columns.count();
+    unsigned fields = 1;
+    bool line_start = true, comment = false, quoted = false;
+    if (fseeko(data, start, SEEK_SET) == -1)
+        err(1, "fseek(%s)", name.c_str());
+    while ((len = fread(buf, 1, sizeof(buf), data)) > 0) {
+        out.clear();
+        for (size_t i = 0; i < len; i++) {
+            char c = buf[i];
+            if (line_start)
+                comment = c == '#';
+            line_start = false;
+            // Quoted fields can contain commas and newlines
+            if (c == '"' && !comment)
+                quoted = !quoted;
+            else if (c == ',' && !quoted && !comment)
+                fields++;
+            else if (c == '\n' && !quoted) {
+                if (!comment && fields < width)
+                    out.append(width - fields, ',');
+                fields = 1;
+                line_start = true;
+            }
+            out.push_back(c);
+        }
+        fwrite(out.data(), 1, out.size(), fp);
+    }
+
+    if (ferror(data) || fflush(fp) != 0 || ferror(fp)) {
+        warnx("Cannot rewrite header of %s", name.c_str());
+        fclose(fp);
+        unlink(tmp.c_str());
+        fp = data;
+        return;
+    }
+    fclose(data);
+    if (rename(tmp.c_str(), name.c_str()) == -1)
+        err(1, "rename(%s)", tmp.c_str());
+}
+
+void CsvOutput::rotateIfNeeded(double time)
+{
+    if (isnan(segment_start))
+        segment_start = time;
+
+    if ((rotate_bytes > 0 && ftello(fp) >= rotate_bytes) || (rotate_ms > 0 && time - segment_start >= rotate_ms)) {
+        closeSegment();
+        segment++;
+        segment_start = time;
+        openSegment();
+        writeHeaderLines();
+    }
+}
+
+void CsvOutput::write(const CsvRow &row)
+{
+    if (rotate_bytes > 0 || rotate_ms > 0)
+        rotateIfNeeded(row.getNumber(time_column.getOrder()));
+    if (columns.count() > listed_columns)
+        listNewColumns();
+
+    switch (format) {
+    case WIDE:
+        row.write(fp);
+        break;
+    case LONG:
+        row.writeLong(fp, time_column);
+        break;
+    }
+}
+
+void CsvOutput::writeComment(const string &comment)
+{
+    fprintf(fp, "# %s\n", comment.c_str());
+}
+
+void CsvOutput::flush()
+{
+    fflush(fp);
+}
+
+void CsvOutput::close()
+{
+    if (file == "-") {
+        fclose(fp);
+        fp = nullptr;
+    } else {
+        closeSegment();
+    }
+}
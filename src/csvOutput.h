@@ -0,0 +1,78 @@
+#ifndef CSVOUTPUT_H
+#define CSVOUTPUT_H
+
+#include "csvRow.h"
+#include <math.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// Destination of CSV rows. Besides the traditional "wide" layout with
+// one column per value, it supports the "long" layout, where every
+// value is stored as a separate "time,column,value" record and the
+// column names are listed in the header. The latter is more compact
+// when rows are sparse, e.g. with many --column keys.
+//
+// The output can be split into segments of limited size or duration.
+// Every segment starts with the same header.
+//
+// Columns can be added after the header is written (--column
+// patterns). They are announced by a "# column N: NAME" comment
+// before the next row and the header of the wide layout is rewritten
+// when the segment is closed (unless writing to a pipe).
+class CsvOutput {
+public:
+    enum Format { WIDE, LONG };
+
+    CsvOutput(const CsvColumns &columns, const CsvColumn &time_column, Format format)
+        : format(format)
+        , columns(columns)
+        , time_column(time_column)
+    {
+    }
+
+    CsvOutput(const CsvOutput &) = delete;
+    void operator=(const CsvOutput &) = delete;
+
+    // Start a new segment after the current one reaches the size or
+    // duration. Must be set before open().
+    void setRotation(off_t max_bytes, double max_ms);
+
+    void open(const char *file);
+    void writeHeader(const string &comment);
+    void write(const CsvRow &row);
+    void writeComment(const string &comment);
+    void flush();
+    void close();
+
+    // Name of the file where the segment is stored
+    string segmentName(unsigned segment) const;
+    unsigned segmentCount() const { return segment + 1; }
+
+    const Format format;
+
+private:
+    const CsvColumns &columns;
+    const CsvColumn &time_column;
+    FILE *fp = nullptr;
+
+    string file = {};
+    string header_comment = {};
+    off_t rotate_bytes = 0;
+    double rotate_ms = 0;
+    unsigned segment = 0;
+    double segment_start = NAN;
+    off_t prealloc = 0;
+    size_t listed_columns = 0; // Columns announced in the current segment
+    size_t header_columns = 0; // Columns in the header of the current segment
+    off_t data_start = 0;      // Offset of the first row in the current segment
+
+    void openSegment();
+    void closeSegment();
+    void writeHeaderLines();
+    void writeColumnLine(const CsvColumn &column);
+    void listNewColumns();
+    void rewriteHeader();
+    void rotateIfNeeded(double time);
+};
+
+#endif
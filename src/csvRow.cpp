@@ -1,4 +1,13 @@
 #include "csvRow.h"
+#include <algorithm>
+#include <charconv>
+#include <ctype.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 /* CsvColumn implementation */
 
@@ -26,47 +35,120 @@ const CsvColumn &CsvColumns::add(string header)
     return columns.back();
 }
 
-void CsvColumns::setHeader(CsvRow &row)
+void CsvColumns::setHeader(CsvRow &row) const
 {
     for (const CsvColumn &column : columns) {
         row.set(column, column.getHeader());
     }
 }
 
+const CsvColumn *CsvColumns::find(const string &name) const
+{
+    for (const CsvColumn &column : columns) {
+        const string &header = column.getHeader();
+        if (header == name || header.substr(0, header.find('/')) == name)
+            return &column;
+    }
+    return nullptr;
+}
+
+CsvCell::Type parseNumber(string_view text, int64_t &integer, double &number)
+{
+    const char *first = text.data(), *last = first + text.size();
+    if (first != last && *first == '+')
+        first++; // Not accepted by from_chars
+
+    number = NAN;
+    if (first == last)
+        return CsvCell::TEXT;
+
+    auto i = from_chars(first, last, integer);
+    if (i.ec == errc() && i.ptr == last) {
+        number = integer;
+        return CsvCell::INT;
+    }
+    double d;
+    auto f = from_chars(first, last, d);
+    if (f.ec == errc() && f.ptr == last) {
+        number = d;
+        return CsvCell::DOUBLE;
+    }
+    // Words like "information" start with "inf" - only flag values
+    // starting with a digit as malformed
+    bool digits = isdigit((unsigned char)first[0])
+        || (last - first > 1 && (first[0] == '-' || first[0] == '.') && isdigit((unsigned char)first[1]));
+    return digits ? CsvCell::MALFORMED : CsvCell::TEXT;
+}
+
 /* CsvRow implementation */
 void CsvRow::set(const CsvColumn &column, double data)
 {
     char buf[100];
     sprintf(buf, "%g", data);
     set(column, buf);
+
+    // Consumers of the row (rates, windows, ...) get the value before
+    // %g rounding, which is too coarse e.g. for times of long runs
+    CsvCell &c = row[column.getOrder()];
+    c.number = data;
+    if (c.type == CsvCell::INT && data != c.integer)
+        c.type = CsvCell::DOUBLE;
 };
 
-void CsvRow::set(const CsvColumn &column, const string &data)
+void CsvRow::setExact(const CsvColumn &column, double data)
 {
-    const unsigned int order = column.getOrder();
-    string esc_data = csvEscape(data);
-    m_empty = false;
-    if (order < row.size()) {
-        row[order] = esc_data;
-    } else {
-        while (row.size() < order) {
-            row.push_back("");
-        }
-        row.push_back(esc_data);
-    }
+    char buf[100];
+    sprintf(buf, "%.15g", data);
+    set(column, buf);
+};
+
+void CsvRow::set(const CsvColumn &column, string_view data)
+{
+    // Escape directly into the cell to reuse its memory
+    CsvCell &c = cell(column.getOrder(), !data.empty());
+    c.text.clear();
+    csvEscapeAppend(c.text, data);
+    c.type = parseNumber(data, c.integer, c.number);
+};
+
+void CsvRow::setEscaped(const CsvColumn &column, const string &esc_data)
+{
+    CsvCell &c = cell(column.getOrder(), !esc_data.empty());
+    c.text = esc_data;
+    // Numbers never need escaping
+    c.type = parseNumber(esc_data, c.integer, c.number);
 };
 
+// Return the cell to be (over)written and track whether it will be
+// filled or empty
+CsvCell &CsvRow::cell(unsigned order, bool filling)
+{
+    m_empty = false;
+    if (order >= row.size())
+        row.resize(order + 1);
+    if (row[order].text.empty() && filling)
+        filled.push_back(order);
+    else if (!row[order].text.empty() && !filling)
+        filled.erase(find(filled.begin(), filled.end(), order));
+    return row[order];
+}
+
 string CsvRow::getValue(const CsvColumn &column) const
 {
-    const unsigned int order = column.getOrder();
-    return (order < row.size()) ? row[column.getOrder()] : "";
+    return getValue(column.getOrder());
+}
+
+const CsvCell &CsvRow::getCell(unsigned order) const
+{
+    static const CsvCell empty;
+    return (order < row.size()) ? row[order] : empty;
 }
 
 string CsvRow::toString() const
 {
     string line;
-    for (const string &str : row) {
-        line.append(str);
+    for (const CsvCell &c : row) {
+        line.append(c.text);
         line.push_back(',');
     }
     line.pop_back(); // remove last ','
@@ -74,32 +156,104 @@ string CsvRow::toString() const
     return line;
 }
 
-void CsvRow::write(FILE *fp)
+void CsvRow::write(FILE *fp) const
 {
     if (fp)
         fprintf(fp, "%s", (toString()).c_str());
 }
 
+void CsvRow::writeLong(FILE *fp, const CsvColumn &time_column) const
+{
+    if (!fp)
+        return;
+    const string &time = row[time_column.getOrder()].text;
+    for (unsigned order : filled) {
+        if (order != time_column.getOrder())
+            fprintf(fp, "%s,%u,%s\n", time.c_str(), order, row[order].text.c_str());
+    }
+}
+
 void CsvRow::clear()
 {
-    row.clear();
-    row.resize(num_columns);
+    // Only touch the cells that were set - rows are typically sparse
+    for (unsigned order : filled) {
+        CsvCell &c = row[order];
+        c.text.clear();
+        c.type = CsvCell::TEXT;
+        c.number = NAN;
+    }
+    filled.clear();
+    if (row.size() < num_columns)
+        row.resize(num_columns);
     m_empty = true;
 }
 
-string csvEscape(string unsafe)
+// Return the index of the first character that needs escaping
+// (comma, quote, CR or LF) or unsafe.size() if there is none.
+static size_t find_special(string_view unsafe)
 {
-    // Each of the embedded double-quote characters
-    // must be represented by a pair of double-quote characters
-    size_t index = 0;
-    while ((index = unsafe.find_first_of('"', index)) != string::npos) {
-        unsafe.insert(index, "\"");
-        index += 2; // after insert index of founded character is incremented, therefore +2
+    const char *p = unsafe.data();
+    const size_t n = unsafe.size();
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i comma = _mm_set1_epi8(','), quote = _mm_set1_epi8('"');
+    const __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, quote)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t comma = vdupq_n_u8(','), quote = vdupq_n_u8('"');
+    const uint8x16_t cr = vdupq_n_u8('\r'), lf = vdupq_n_u8('\n');
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p + i));
+        uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, comma), vceqq_u8(v, quote)),
+                                vorrq_u8(vceqq_u8(v, cr), vceqq_u8(v, lf)));
+        if (vmaxvq_u8(m))
+            break; // Find the exact position below
     }
-    // Fields with embedded commas, quotes or line breaks characters must be quoted
-    if (unsafe.find_first_of(",\"\r\n") != string::npos) {
-        unsafe.insert(0, "\"");
-        unsafe.push_back('"');
+#endif
+    for (; i < n; i++) {
+        switch (p[i]) {
+        case ',':
+        case '"':
+        case '\r':
+        case '\n':
+            return i;
+        }
+    }
+    return n;
+}
+
+void csvEscapeAppend(string &out, string_view unsafe)
+{
+    size_t pos = find_special(unsafe);
+    if (pos == unsafe.size()) {
+        // Common case - nothing to escape
+        out.append(unsafe);
+        return;
     }
-    return unsafe;
+
+    // Fields with embedded commas, quotes or line breaks characters
+    // must be quoted and each of the embedded double-quote characters
+    // must be represented by a pair of double-quote characters.
+    out.reserve(out.size() + unsafe.size() + 2);
+    out.push_back('"');
+    out.append(unsafe.substr(0, pos));
+    for (size_t quote; (quote = unsafe.find('"', pos)) != string_view::npos; pos = quote + 1)
+        out.append(unsafe.substr(pos, quote + 1 - pos)).push_back('"');
+    out.append(unsafe.substr(pos));
+    out.push_back('"');
+}
+
+string csvEscape(string_view unsafe)
+{
+    string escaped;
+    csvEscapeAppend(escaped, unsafe);
+    return escaped;
 }
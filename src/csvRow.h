@@ -3,11 +3,35 @@
 
 #include <iostream>
 #include <list>
+#include <math.h>
+#include <stdint.h>
+#include <string_view>
 #include <vector>
 
 using namespace std;
 
-string csvEscape(string unsafe);
+string csvEscape(string_view unsafe);
+void csvEscapeAppend(string &out, string_view unsafe);
+
+// Value of a CSV cell. Numbers are parsed once when the value is
+// stored, so that consumers of rows (statistics, conditions, derived
+// columns, ...) need not parse the text again. The text is kept as
+// received and written to the output.
+struct CsvCell {
+    enum Type : uint8_t {
+        TEXT,
+        INT,
+        DOUBLE,
+        MALFORMED, // Number followed by other characters, e.g. "12ms"
+    };
+    string text = {}; // Escaped
+    Type type = TEXT;
+    int64_t integer = 0; // Valid for INT
+    double number = NAN; // Valid for INT and DOUBLE, NaN otherwise
+};
+
+// Parse text as a whole with from_chars and return its type
+CsvCell::Type parseNumber(string_view text, int64_t &integer, double &number);
 
 class CsvRow;
 
@@ -31,17 +55,26 @@ private:
 public:
     const CsvColumn &add(string header);
 
-    void setHeader(CsvRow &row);
+    void setHeader(CsvRow &row) const;
 
     size_t count() const { return columns.size(); }
+
+    // Find column by its header, optionally without the unit
+    const CsvColumn *find(const string &name) const;
+
+    list<CsvColumn>::const_iterator begin() const { return columns.begin(); }
+    list<CsvColumn>::const_iterator end() const { return columns.end(); }
 };
 
 class CsvRow {
 private:
     size_t num_columns;
-    vector<string> row { num_columns };
+    vector<CsvCell> row { num_columns };
+    vector<unsigned> filled = {}; // Orders of non-empty cells
     bool m_empty = true;
 
+    CsvCell &cell(unsigned order, bool filling);
+
 public:
     CsvRow(const CsvColumns &cols)
         : num_columns(cols.count())
@@ -49,14 +82,24 @@ public:
         clear();
     }
 
-    void set(const CsvColumn &column, double data);
-    void set(const CsvColumn &column, const string &data);
+    void set(const CsvColumn &column, double data); // Text rounded by %g, number exact
+    void setExact(const CsvColumn &column, double data); // Unlike set(), keep precision of large values
+    void set(const CsvColumn &column, string_view data);
+    void setEscaped(const CsvColumn &column, const string &data); // data already passed through csvEscape()
 
     string getValue(const CsvColumn &column) const;
+    const string &getValue(unsigned order) const { return getCell(order).text; }
+    const CsvCell &getCell(unsigned order) const;
+    // Numeric value of the cell or NaN if it is empty or not a number
+    double getNumber(unsigned order) const { return getCell(order).number; }
+    const vector<unsigned> &getFilled() const { return filled; }
 
     string toString() const;
 
-    void write(FILE *fp);
+    void write(FILE *fp) const;
+
+    // Write one "time,column,value" record per non-empty cell
+    void writeLong(FILE *fp, const CsvColumn &time_column) const;
 
     void clear();
 
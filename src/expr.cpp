@@ -0,0 +1,281 @@
+#include "expr.h"
+#include <ctype.h>
+#include <err.h>
+#include <math.h>
+#include <stdlib.h>
+
+static const struct {
+    const char *name;
+    double (*fn)(double);
+} functions1[] = {
+    { "abs", fabs }, { "sqrt", sqrt }, { "exp", exp }, { "log", log },
+    { "floor", floor }, { "ceil", ceil }, { "round", round },
+};
+
+static double ifnan(double x, double y)
+{
+    return isnan(x) ? y : x;
+}
+
+static const struct {
+    const char *name;
+    double (*fn)(double, double);
+} functions2[] = {
+    { "min", fmin },
+    { "max", fmax },
+    { "ifnan", ifnan },
+};
+
+Expr::Expr(const string &expr, const CsvColumns &columns)
+    : text(expr)
+    , columns(columns)
+{
+    parseExpr();
+    skipSpace();
+    if (pos < text.size())
+        error("Unexpected character");
+}
+
+void Expr::error(const char *msg)
+{
+    errx(1, "--derive: %s at position %zu: %s", msg, pos + 1, text.c_str());
+}
+
+void Expr::emit(const Instr &i)
+{
+    switch (i.op) {
+    case CONST:
+    case COLUMN:
+    case PREV:
+        depth++;
+        break;
+    case NEG:
+    case CALL1:
+        break;
+    default:
+        depth--;
+    }
+    if (depth > stack.size())
+        stack.resize(depth);
+    code.push_back(i);
+}
+
+void Expr::skipSpace()
+{
+    while (pos < text.size() && isspace((unsigned char)text[pos]))
+        pos++;
+}
+
+bool Expr::accept(char c)
+{
+    skipSpace();
+    if (pos < text.size() && text[pos] == c) {
+        pos++;
+        return true;
+    }
+    return false;
+}
+
+void Expr::expect(char c)
+{
+    if (!accept(c))
+        errx(1, "--derive: Expected '%c' at position %zu: %s", c, pos + 1, text.c_str());
+}
+
+string Expr::parseIdent()
+{
+    skipSpace();
+    size_t start = pos;
+    while (pos < text.size() && (isalnum((unsigned char)text[pos]) || text[pos] == '_'))
+        pos++;
+    if (pos == start)
+        error("Expected name");
+    return text.substr(start, pos - start);
+}
+
+const CsvColumn &Expr::findColumn(const string &name)
+{
+    const CsvColumn *col = columns.find(name);
+    if (!col)
+        errx(1, "--derive: Unknown column '%s' in: %s", name.c_str(), text.c_str());
+    return *col;
+}
+
+// expr := term (('+' | '-') term)*
+void Expr::parseExpr()
+{
+    parseTerm();
+    while (true) {
+        if (accept('+')) {
+            parseTerm();
+            emit({ ADD });
+        } else if (accept('-')) {
+            parseTerm();
+            emit({ SUB });
+        } else {
+            break;
+        }
+    }
+}
+
+// term := unary (('*' | '/' | '%') unary)*
+void Expr::parseTerm()
+{
+    parseUnary();
+    while (true) {
+        if (accept('*')) {
+            parseUnary();
+            emit({ MUL });
+        } else if (accept('/')) {
+            parseUnary();
+            emit({ DIV });
+        } else if (accept('%')) {
+            parseUnary();
+            emit({ MOD });
+        } else {
+            break;
+        }
+    }
+}
+
+// unary := '-' unary | power
+void Expr::parseUnary()
+{
+    if (accept('-')) {
+        parseUnary();
+        emit({ NEG });
+    } else {
+        parsePower();
+    }
+}
+
+// power := primary ('^' unary)?
+void Expr::parsePower()
+{
+    parsePrimary();
+    if (accept('^')) {
+        parseUnary();
+        emit({ POW });
+    }
+}
+
+// primary := NUMBER | '(' expr ')' | COLUMN | 'prev' '(' COLUMN ')' | FUNCTION '(' args ')'
+void Expr::parsePrimary()
+{
+    skipSpace();
+    if (pos >= text.size())
+        error("Unexpected end");
+
+    if (accept('(')) {
+        parseExpr();
+        expect(')');
+        return;
+    }
+
+    if (isdigit((unsigned char)text[pos]) || text[pos] == '.') {
+        const char *start = text.c_str() + pos;
+        char *end;
+        double value = strtod(start, &end);
+        if (end == start)
+            error("Invalid number");
+        pos += end - start;
+        emit({ CONST, value });
+        return;
+    }
+
+    string name = parseIdent();
+    if (!accept('(')) {
+        emit({ COLUMN, 0, findColumn(name).getOrder() });
+        return;
+    }
+
+    if (name == "prev") {
+        const CsvColumn &col = findColumn(parseIdent());
+        expect(')');
+        prev.push_back({ col, NAN });
+        emit({ PREV, 0, unsigned(prev.size() - 1) });
+        return;
+    }
+    for (const auto &f : functions1) {
+        if (name == f.name) {
+            parseExpr();
+            expect(')');
+            emit({ CALL1, 0, 0, f.fn });
+            return;
+        }
+    }
+    for (const auto &f : functions2) {
+        if (name == f.name) {
+            parseExpr();
+            expect(',');
+            parseExpr();
+            expect(')');
+            emit({ CALL2, 0, 0, nullptr, f.fn });
+            return;
+        }
+    }
+    errx(1, "--derive: Unknown function '%s' in: %s", name.c_str(), text.c_str());
+}
+
+double Expr::eval(const CsvRow &row)
+{
+    double *sp = stack.data(); // Points after the top of the stack
+
+    for (const Instr &i : code) {
+        switch (i.op) {
+        case CONST:
+            *sp++ = i.value;
+            break;
+        case COLUMN:
+            *sp++ = row.getNumber(i.idx);
+            break;
+        case PREV:
+            *sp++ = prev[i.idx].value;
+            break;
+        case NEG:
+            sp[-1] = -sp[-1];
+            break;
+        case ADD:
+            sp--;
+            sp[-1] += sp[0];
+            break;
+        case SUB:
+            sp--;
+            sp[-1] -= sp[0];
+            break;
+        case MUL:
+            sp--;
+            sp[-1] *= sp[0];
+            break;
+        case DIV:
+            sp--;
+            sp[-1] /= sp[0];
+            break;
+        case MOD:
+            sp--;
+            sp[-1] = fmod(sp[-1], sp[0]);
+            break;
+        case POW:
+            sp--;
+            sp[-1] = pow(sp[-1], sp[0]);
+            break;
+        case CALL1:
+            sp[-1] = i.fn1(sp[-1]);
+            break;
+        case CALL2:
+            sp--;
+            sp[-1] = i.fn2(sp[-1], sp[0]);
+            break;
+        }
+    }
+    return stack[0];
+}
+
+void Expr::update(const CsvRow &row)
+{
+    for (Prev &p : prev) {
+        double v = row.getNumber(p.column.getOrder());
+        if (!isnan(v))
+            p.value = v;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include "csvRow.h"
+#include <string>
+#include <vector>
+
+// Arithmetic expression over column values, compiled to a sequence
+// of stack machine instructions. Supported are numbers, column
+// references (header with or without unit), operators + - * / % ^,
+// parentheses, functions abs, sqrt, exp, log, floor, ceil, round,
+// min, max, ifnan and prev(COL), which returns the value COL had in
+// the previously evaluated row. Missing values evaluate to NaN.
+class Expr {
+public:
+    Expr(const string &expr, const CsvColumns &columns);
+
+    double eval(const CsvRow &row);
+
+    // Remember values for prev() - call after all expressions were
+    // evaluated and stored to the row.
+    void update(const CsvRow &row);
+
+    const string text;
+
+private:
+    enum Op { CONST, COLUMN, PREV, NEG, ADD, SUB, MUL, DIV, MOD, POW, CALL1, CALL2 };
+    struct Instr {
+        Op op;
+        double value;  // CONST
+        unsigned idx;  // COLUMN: column order, PREV: index to prev
+        double (*fn1)(double);
+        double (*fn2)(double, double);
+    };
+    struct Prev {
+        const CsvColumn &column;
+        double value;
+    };
+
+    const CsvColumns &columns;
+    vector<Instr> code = {};
+    vector<Prev> prev = {};
+    vector<double> stack = {};
+
+    // Recursive descent parser state
+    size_t pos = 0;
+    size_t depth = 0;
+
+    void emit(const Instr &i);
+    void parseExpr();
+    void parseTerm();
+    void parseUnary();
+    void parsePower();
+    void parsePrimary();
+    void skipSpace();
+    bool accept(char c);
+    void expect(char c);
+    string parseIdent();
+    const CsvColumn &findColumn(const string &name);
+    [[noreturn]] void error(const char *msg);
+};
+
+#endif
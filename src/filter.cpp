@@ -0,0 +1,59 @@
+#include "filter.h"
+#include <err.h>
+#include <stdlib.h>
+
+Filter Filter::parse(const string &spec)
+{
+    if (spec == "mean")
+        return Filter(MEAN, 0);
+    if (spec.compare(0, 8, "lowpass=") == 0) {
+        char *end;
+        double tc = strtod(spec.c_str() + 8, &end);
+        if (end == spec.c_str() + 8 || *end != '\0' || tc <= 0)
+            errx(1, "Invalid low-pass filter time constant: %s", spec.c_str() + 8);
+        return Filter(LOWPASS, tc);
+    }
+    errx(1, "Unknown filter: %s", spec.c_str());
+}
+
+void Filter::add(double value, double time_ms)
+{
+    if (isnan(value))
+        return;
+
+    switch (type) {
+    case MEAN:
+        y = count ? y + value : value;
+        break;
+    case LOWPASS:
+        if (count == 0) {
+            y = value;
+        } else {
+            // Use the real sampling interval so that timer jitter
+            // does not change the filter dynamics
+            double dt = time_ms - last_ms;
+            double alpha = dt / (tc_ms + dt);
+            y = (1 - alpha) * y + alpha * value;
+        }
+        break;
+    }
+    last_ms = time_ms;
+    count++;
+}
+
+double Filter::output()
+{
+    if (count == 0)
+        return NAN;
+
+    switch (type) {
+    case MEAN: {
+        double mean = y / count;
+        count = 0;
+        return mean;
+    }
+    case LOWPASS:
+        return y;
+    }
+    return NAN;
+}
@@ -0,0 +1,43 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <math.h>
+#include <string>
+
+using namespace std;
+
+// Filter applied to an oversampled sensor. The sensor is sampled
+// faster than the row period and the filter output is stored once
+// per row.
+class Filter {
+public:
+    enum Type {
+        MEAN, // Average of the samples taken since the last output
+        LOWPASS, // First order IIR low-pass filter
+    };
+
+    // SPEC is "mean" or "lowpass=TIME_CONSTANT_MS"
+    static Filter parse(const string &spec);
+
+    // Feed a sample taken at time_ms. NaN samples are ignored.
+    void add(double value, double time_ms);
+
+    // Return the filter output for the current row (NaN if there is
+    // nothing to output)
+    double output();
+
+private:
+    Filter(Type type, double tc_ms)
+        : type(type)
+        , tc_ms(tc_ms)
+    {
+    }
+
+    Type type;
+    double tc_ms;
+    double y = NAN; // LOWPASS: filter state, MEAN: sum of samples
+    double last_ms = NAN;
+    unsigned count = 0;
+};
+
+#endif
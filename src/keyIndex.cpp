@@ -0,0 +1,66 @@
+#include "keyIndex.h"
+#include <stdint.h>
+
+// FNV-1a
+size_t KeyIndex::hash(string_view key)
+{
+    uint64_t h = 0xcbf29ce484222325;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+void KeyIndex::build(const vector<string_view> &keys)
+{
+    // Keep the load factor at most 1/2 to make probe sequences short
+    size_t size = 4;
+    while (size < 2 * keys.size())
+        size *= 2;
+    slots.assign(size, Slot());
+    mask = size - 1;
+    used = 0;
+
+    for (unsigned pos = 0; pos < keys.size(); pos++)
+        insert(keys[pos], pos);
+}
+
+void KeyIndex::insert(string_view key, unsigned pos)
+{
+    if (key.empty() || find(key) != npos)
+        return;
+    if (2 * (used + 1) > slots.size())
+        resize(slots.empty() ? 4 : 2 * slots.size());
+    place({ string(key), pos });
+}
+
+void KeyIndex::resize(size_t size)
+{
+    vector<Slot> old(size);
+    old.swap(slots);
+    mask = size - 1;
+    used = 0;
+    for (Slot &slot : old)
+        if (slot.pos != npos)
+            place(move(slot));
+}
+
+void KeyIndex::place(Slot slot)
+{
+    size_t i = hash(slot.key) & mask;
+    while (slots[i].pos != npos)
+        i = (i + 1) & mask;
+    slots[i] = move(slot);
+    used++;
+}
+
+unsigned KeyIndex::find(string_view key) const
+{
+    if (slots.empty())
+        return npos;
+    for (size_t i = hash(key) & mask; slots[i].pos != npos; i = (i + 1) & mask)
+        if (slots[i].key == key)
+            return slots[i].pos;
+    return npos;
+}
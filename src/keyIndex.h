@@ -0,0 +1,45 @@
+#ifndef KEYINDEX_H
+#define KEYINDEX_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Hash table mapping keys of KEY=value lines to positions in an array
+// of columns. It is built once all keys are known and then finds a
+// key in constant time regardless of the number of keys (open
+// addressing with linear probing). Keys can also be inserted later,
+// e.g. for columns created by --column patterns.
+class KeyIndex {
+public:
+    static constexpr unsigned npos = ~0u;
+
+    // Index keys[i] as i. Empty keys are skipped, for duplicate keys
+    // the first one wins.
+    void build(const vector<string_view> &keys);
+
+    // Index key as pos unless it is empty or already present
+    void insert(string_view key, unsigned pos);
+
+    // Return the position of key or npos if not present
+    unsigned find(string_view key) const;
+
+    size_t size() const { return used; }
+
+private:
+    struct Slot {
+        string key = {};
+        unsigned pos = npos;
+    };
+    vector<Slot> slots = {};
+    size_t mask = 0;
+    size_t used = 0;
+
+    static size_t hash(string_view key);
+    void resize(size_t size);
+    void place(Slot slot);
+};
+
+#endif
@@ -0,0 +1,59 @@
+#include "lineBuffer.h"
+#include <algorithm>
+#include <string.h>
+
+char *LineBuffer::space()
+{
+    if (start > 0) {
+        memmove(buf.data(), buf.data() + start, end - start);
+        end -= start;
+        scan -= start;
+        start = 0;
+    }
+    return buf.data() + end;
+}
+
+size_t LineBuffer::append(const char *data, size_t len)
+{
+    char *dst = space();
+    len = min(len, available());
+    memcpy(dst, data, len);
+    commit(len);
+    return len;
+}
+
+void LineBuffer::terminate()
+{
+    char *dst = space();
+    if (end > start && !discard && available() > 0) {
+        *dst = '\n';
+        commit(1);
+    }
+}
+
+bool LineBuffer::next(string_view &line)
+{
+    while (true) {
+        char *eol = static_cast<char *>(memchr(buf.data() + scan, '\n', end - scan));
+        if (!eol) {
+            scan = end;
+            if (discard)
+                start = end;
+            if (discard || end - start < buf.size())
+                return false;
+            // The line does not fit into the buffer
+            line = string_view(buf.data() + start, end - start);
+            start = end;
+            discard = true;
+            truncated_count++;
+            return true;
+        }
+
+        size_t pos = eol - buf.data();
+        line = string_view(buf.data() + start, pos - start);
+        start = scan = pos + 1;
+        if (!discard)
+            return true;
+        discard = false;
+    }
+}
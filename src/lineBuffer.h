@@ -0,0 +1,52 @@
+#ifndef LINEBUFFER_H
+#define LINEBUFFER_H
+
+#include "util.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Splits a stream into lines without copying them. Data is appended
+// to a fixed-size buffer, which is compacted only when more space is
+// requested, i.e. at most once per read. Lines that do not fit into
+// the buffer are truncated to its size and the rest of the line is
+// discarded.
+class LineBuffer {
+public:
+    LineBuffer(size_t max_line)
+        : buf(max_line)
+    {
+    }
+
+    // Discard consumed data and return the space for appending new
+    // data (at least one byte after all lines were consumed)
+    char *space();
+    size_t available() const { return buf.size() - end; }
+    // Append len bytes written to space()
+    void commit(size_t len) { end += len; }
+    // Copy as much data as fits, return the number of bytes copied
+    size_t append(const char *data, size_t len);
+    // Terminate the last incomplete line at the end of the stream. All
+    // complete lines must be consumed before.
+    void terminate();
+    void clear() { start = scan = end = 0, discard = false; }
+
+    // Return the next complete line without the trailing '\n'. The
+    // line is valid until the next call to space().
+    bool next(string_view &line);
+
+    // Number of truncated lines
+    unsigned long truncated() const { return truncated_count; }
+
+private:
+    vector<char, default_init_allocator<char>> buf;
+    size_t start = 0; // Start of the first unconsumed line
+    size_t scan = 0; // Where to continue searching for '\n'
+    size_t end = 0; // End of data
+    bool discard = false; // Discarding the rest of a truncated line
+    unsigned long truncated_count = 0;
+};
+
+#endif
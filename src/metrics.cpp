@@ -0,0 +1,216 @@
+#include "metrics.h"
+#include <charconv>
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const size_t max_request = 0x2000;
+
+MetricsServer::MetricsServer(const CsvColumns &columns, const string &addr)
+    : columns(columns)
+    , host("127.0.0.1")
+    , port(addr)
+{
+    size_t colon = addr.rfind(':');
+    if (colon != string::npos) {
+        host = addr.substr(0, colon);
+        port = addr.substr(colon + 1);
+        if (host.size() > 2 && host.front() == '[' && host.back() == ']')
+            host = host.substr(1, host.size() - 2); // IPv6 literal
+    }
+    if (port.empty())
+        errx(1, "Missing port in metrics address: %s", addr.c_str());
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+void MetricsServer::start(ev::loop_ref loop)
+{
+    struct addrinfo hints = {}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int ret = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &res);
+    if (ret != 0)
+        errx(1, "Metrics address %s:%s: %s", host.c_str(), port.c_str(), gai_strerror(ret));
+
+    listen_fd = socket(res->ai_family, res->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, res->ai_protocol);
+    if (listen_fd == -1)
+        err(1, "socket");
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listen_fd, res->ai_addr, res->ai_addrlen) == -1)
+        err(1, "bind(%s:%s)", host.c_str(), port.c_str());
+    freeaddrinfo(res);
+    if (listen(listen_fd, 8) == -1)
+        err(1, "listen");
+
+    accept_watcher.set(loop);
+    accept_watcher.set<MetricsServer, &MetricsServer::accept_cb>(this);
+    accept_watcher.start(listen_fd, ev::READ);
+}
+
+void MetricsServer::stop()
+{
+    while (!connections.empty())
+        close(connections.front().get());
+    if (listen_fd == -1)
+        return;
+    accept_watcher.stop();
+    ::close(listen_fd);
+    listen_fd = -1;
+}
+
+void MetricsServer::update(const CsvRow &row)
+{
+    if (values.size() < columns.count())
+        values.resize(columns.count());
+    for (unsigned order : row.getFilled()) {
+        const CsvCell &cell = row.getCell(order);
+        if (cell.type == CsvCell::INT || cell.type == CsvCell::DOUBLE)
+            values[order] = cell.number;
+        else
+            values[order].reset(); // Not a number
+    }
+}
+
+void MetricsServer::accept_cb(ev::io &w, int revents)
+{
+    int fd = accept4(w.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1) {
+        if (errno != EAGAIN && errno != ECONNABORTED)
+            warn("metrics: accept");
+        return;
+    }
+    connections.emplace_back(make_unique<Connection>());
+    Connection *conn = connections.back().get();
+    conn->watcher.set(w.loop);
+    conn->watcher.set<MetricsServer, &MetricsServer::connection_cb>(this);
+    conn->watcher.start(fd, ev::READ);
+}
+
+void MetricsServer::close(Connection *conn)
+{
+    conn->watcher.stop();
+    ::close(conn->watcher.fd);
+    connections.remove_if([conn](const unique_ptr<Connection> &c) { return c.get() == conn; });
+}
+
+void MetricsServer::connection_cb(ev::io &w, int revents)
+{
+    Connection *conn = nullptr;
+    for (auto &c : connections)
+        if (&c->watcher == &w)
+            conn = c.get();
+
+    if (revents & ev::READ) {
+        char buf[1024];
+        ssize_t len = read(w.fd, buf, sizeof(buf));
+        if (len == -1 && (errno == EAGAIN || errno == EINTR))
+            return;
+        if (len <= 0) {
+            close(conn);
+            return;
+        }
+        conn->request.append(buf, len);
+        if (conn->request.find("\r\n\r\n") == string::npos && conn->request.find("\n\n") == string::npos) {
+            if (conn->request.size() > max_request)
+                close(conn);
+            return;
+        }
+
+        string status = "200 OK", type, body;
+        if (conn->request.compare(0, 4, "GET ") == 0) {
+            type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+            body = render();
+        } else {
+            status = "405 Method Not Allowed";
+            type = "text/plain";
+            body = status + "\n";
+        }
+        conn->response = "HTTP/1.1 " + status + "\r\nContent-Type: " + type
+            + "\r\nContent-Length: " + to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        w.set(ev::WRITE);
+    }
+
+    if (revents & ev::WRITE) {
+        ssize_t len = write(w.fd, conn->response.data(), conn->response.size());
+        if (len == -1 && (errno == EAGAIN || errno == EINTR))
+            return;
+        if (len == -1) {
+            close(conn);
+            return;
+        }
+        conn->response.erase(0, len);
+        if (conn->response.empty())
+            close(conn);
+    }
+}
+
+// Convert the column header (without unit) to a valid metric name
+static string metric_name(const string &header)
+{
+    string name = "thermobench_" + header.substr(0, header.find('/'));
+    for (char &c : name)
+        if (!isalnum((unsigned char)c) && c != '_' && c != ':')
+            c = '_';
+    return name;
+}
+
+static string help_escape(const string &s)
+{
+    string out;
+    for (char c : s) {
+        if (c == '\\')
+            out += "\\\\";
+        else if (c == '\n')
+            out += "\\n";
+        else
+            out += c;
+    }
+    return out;
+}
+
+// Format the value as OpenMetrics requires
+static string metric_value(double v)
+{
+    if (isnan(v))
+        return "NaN";
+    if (isinf(v))
+        return v > 0 ? "+Inf" : "-Inf";
+    char buf[32];
+    return string(buf, to_chars(buf, buf + sizeof(buf), v).ptr);
+}
+
+string MetricsServer::render() const
+{
+    string out;
+    set<string> names;
+
+    for (const CsvColumn &col : columns) {
+        unsigned order = col.getOrder();
+        if (order >= values.size() || !values[order])
+            continue;
+
+        string name = metric_name(col.getHeader());
+        if (!names.insert(name).second) {
+            name += "_" + to_string(order);
+            names.insert(name);
+        }
+        out += "# TYPE " + name + " gauge\n";
+        out += "# HELP " + name + " " + help_escape(col.getHeader()) + "\n";
+        out += name + " " + metric_value(*values[order]) + "\n";
+    }
+    out += "# EOF\n";
+    return out;
+}
@@ -0,0 +1,60 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "csvRow.h"
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#ifdef WITH_LOCAL_LIBEV
+#define EV_STANDALONE 1
+#include "libev/ev++.h"
+#else
+#include <ev++.h>
+#endif
+
+using namespace std;
+
+// Minimal HTTP server exposing the latest value of every column in
+// the OpenMetrics text format. Rows are recorded into a snapshot by
+// update() and scrapes are served from that snapshot by the event
+// loop with non-blocking I/O, so they never delay sampling.
+class MetricsServer {
+public:
+    // addr is "[HOST:]PORT", HOST defaults to 127.0.0.1
+    MetricsServer(const CsvColumns &columns, const string &addr);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer &) = delete;
+    void operator=(const MetricsServer &) = delete;
+
+    void start(ev::loop_ref loop);
+    // Stop accepting new connections and close the existing ones
+    void stop();
+
+    // Remember the numbers of all filled cells of the row
+    void update(const CsvRow &row);
+
+private:
+    struct Connection {
+        ev::io watcher = {};
+        string request = {};
+        string response = {};
+    };
+
+    const CsvColumns &columns;
+    string host, port;
+    vector<optional<double>> values = {}; // Latest numbers indexed by column order
+    int listen_fd = -1;
+    ev::io accept_watcher = {};
+    list<unique_ptr<Connection>> connections = {};
+
+    void accept_cb(ev::io &w, int revents);
+    void connection_cb(ev::io &w, int revents);
+    void close(Connection *conn);
+    string render() const;
+};
+
+#endif
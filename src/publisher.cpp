@@ -0,0 +1,146 @@
+#include "publisher.h"
+#include <err.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Publisher::~Publisher()
+{
+    stop();
+    while (!clients.empty())
+        disconnect(clients.begin());
+    if (!path.empty() && path[0] != '@')
+        unlink(path.c_str());
+}
+
+void Publisher::start(ev::loop_ref loop, const string &header)
+{
+    this->header = header;
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        errx(1, "Socket path too long: %s", path.c_str());
+    memcpy(addr.sun_path, path.data(), path.size());
+    socklen_t len = offsetof(struct sockaddr_un, sun_path) + path.size();
+    if (path[0] == '@')
+        addr.sun_path[0] = '\0'; // Abstract socket
+    else {
+        // Remove stale socket left by a previous run
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            unlink(path.c_str());
+        len++;
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1)
+        err(1, "socket");
+    if (bind(listen_fd, (struct sockaddr *)&addr, len) == -1)
+        err(1, "bind(%s)", path.c_str());
+    if (listen(listen_fd, 8) == -1)
+        err(1, "listen(%s)", path.c_str());
+
+    accept_watcher.set(loop);
+    accept_watcher.set<Publisher, &Publisher::accept_cb>(this);
+    accept_watcher.start(listen_fd, ev::READ);
+}
+
+void Publisher::stop()
+{
+    if (listen_fd == -1)
+        return;
+    accept_watcher.stop();
+    close(listen_fd);
+    listen_fd = -1;
+    // Do not keep the event loop running because of slow clients
+    for (Client &c : clients)
+        c.writer.stop();
+}
+
+void Publisher::accept_cb(ev::io &w, int revents)
+{
+    int fd = accept4(w.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1) {
+        if (errno != EAGAIN && errno != ECONNABORTED)
+            warn("accept(%s)", path.c_str());
+        return;
+    }
+    clients.emplace_back(fd);
+    Client &c = clients.back();
+    c.writer.set(w.loop);
+    c.writer.set<Publisher, &Publisher::write_cb>(this);
+    if (!send(c, header))
+        disconnect(prev(clients.end()));
+}
+
+void Publisher::write_cb(ev::io &w, int revents)
+{
+    for (auto c = clients.begin(); c != clients.end(); ++c) {
+        if (&c->writer == &w) {
+            if (!flush(*c))
+                disconnect(c);
+            return;
+        }
+    }
+}
+
+void Publisher::disconnect(list<Client>::iterator c)
+{
+    c->writer.stop();
+    close(c->fd);
+    clients.erase(c);
+}
+
+void Publisher::publish(const string &line)
+{
+    for (auto c = clients.begin(); c != clients.end();) {
+        auto next = std::next(c);
+        if (!send(*c, line))
+            disconnect(c);
+        c = next;
+    }
+}
+
+// Send as much of the pending data as the socket accepts. The rest is
+// sent by write_cb when the socket becomes writable. Return false if
+// the client disconnected.
+bool Publisher::flush(Client &c)
+{
+    while (!c.pending.empty()) {
+        ssize_t ret = ::send(c.fd, c.pending.data(), c.pending.size(), MSG_NOSIGNAL);
+        if (ret == -1) {
+            if (errno != EAGAIN && errno != EINTR)
+                return false;
+            break;
+        }
+        c.pending.erase(0, ret);
+        if (c.pending.empty() && c.dropped > 0) {
+            c.pending = "# Dropped " + to_string(c.dropped) + " lines\n";
+            c.dropped = 0;
+        }
+    }
+    if (c.pending.empty())
+        c.writer.stop();
+    else if (!c.writer.is_active() && listen_fd != -1)
+        c.writer.start(c.fd, ev::WRITE);
+    return true;
+}
+
+bool Publisher::send(Client &c, const string &data)
+{
+    if (!c.pending.empty()) {
+        // The client is slow - buffer or drop the data
+        if (c.pending.size() + data.size() > max_pending)
+            c.dropped++;
+        else
+            c.pending += data;
+        return true;
+    }
+    c.pending = data;
+    return flush(c);
+}
@@ -0,0 +1,71 @@
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include <list>
+#include <memory>
+#include <string>
+
+#ifdef WITH_LOCAL_LIBEV
+#define EV_STANDALONE 1
+#include "libev/ev++.h"
+#else
+#include <ev++.h>
+#endif
+
+using namespace std;
+
+// Publishes lines (CSV rows) to any number of clients connected to a
+// Unix domain socket. Clients never block the publisher: when a
+// client does not read fast enough, its lines are buffered up to a
+// limit and then dropped.
+class Publisher {
+public:
+    // Names starting with '@' denote Linux abstract sockets
+    Publisher(const string &path)
+        : path(path)
+    {
+    }
+    ~Publisher();
+
+    Publisher(const Publisher &) = delete;
+    void operator=(const Publisher &) = delete;
+
+    // Start listening. Every new client receives the header first.
+    void start(ev::loop_ref loop, const string &header);
+    // Replace the header sent to clients connecting from now on
+    void setHeader(const string &header) { this->header = header; }
+    // Stop accepting new clients
+    void stop();
+
+    void publish(const string &line);
+
+    bool hasClients() const { return !clients.empty(); }
+
+private:
+    struct Client {
+        int fd;
+        string pending = {}; // Data not yet accepted by the socket
+        unsigned long dropped = 0;
+        ev::io writer = {}; // Active while pending is not empty
+        Client(int fd)
+            : fd(fd)
+        {
+        }
+    };
+
+    static const size_t max_pending = 0x10000;
+
+    const string path;
+    string header = {};
+    int listen_fd = -1;
+    ev::io accept_watcher = {};
+    list<Client> clients = {};
+
+    void accept_cb(ev::io &w, int revents);
+    void write_cb(ev::io &w, int revents);
+    bool send(Client &c, const string &data);
+    bool flush(Client &c);
+    void disconnect(list<Client>::iterator c);
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "rates.h"
+#include <algorithm>
+#include <err.h>
+#include <stdlib.h>
+
+static string header_name(const string &header)
+{
+    return header.substr(0, header.find('/'));
+}
+
+static string header_unit(const string &header)
+{
+    size_t slash = header.find('/');
+    return slash == string::npos ? "" : header.substr(slash + 1);
+}
+
+const CsvColumn &Rates::findColumn(const string &name, const char *opt)
+{
+    const CsvColumn *col = columns.find(name);
+    if (!col)
+        errx(1, "%s: Unknown column: %s", opt, name.c_str());
+    return *col;
+}
+
+Rates::Counter *Rates::addCounter(const CsvColumn &src)
+{
+    counters.push_back(make_unique<Counter>(src));
+    unsigned order = src.getOrder();
+    if (counters_by_order.size() <= order)
+        counters_by_order.resize(order + 1);
+    counters_by_order[order].push_back(counters.back().get());
+    return counters.back().get();
+}
+
+vector<const CsvColumn *> Rates::counterColumns() const
+{
+    vector<const CsvColumn *> cols;
+    for (const auto &c : counters)
+        if (find(cols.begin(), cols.end(), &c->src) == cols.end())
+            cols.push_back(&c->src);
+    return cols;
+}
+
+void Rates::addRate(const string &name)
+{
+    const CsvColumn &src = findColumn(name, "--rate");
+    const string &header = src.getHeader();
+    string unit = header_unit(header);
+    string rate_header = header_name(header) + "_rate/" + (unit.empty() ? "s" : unit + "/s");
+    rates.push_back({ addCounter(src), columns.add(rate_header) });
+}
+
+void Rates::addEnergy(const string &power, const string &work)
+{
+    static const struct {
+        const char *unit;
+        double scale;
+    } units[] = { { "", 1 }, { "W", 1 }, { "mW", 1e-3 }, { "uW", 1e-6 }, { "µW", 1e-6 } };
+
+    const CsvColumn &src = findColumn(power, "--energy");
+    const string &header = src.getHeader();
+    string unit = header_unit(header);
+    double scale = NAN;
+    for (const auto &u : units)
+        if (unit == u.unit)
+            scale = u.scale;
+    if (isnan(scale))
+        errx(1, "--energy: Unsupported power unit: %s", header.c_str());
+
+    auto energy = make_unique<Energy>(src, scale, columns.add(header_name(header) + "_energy/J"));
+    if (!work.empty()) {
+        const CsvColumn &work_col = findColumn(work, "--energy");
+        energy->work = addCounter(work_col);
+        energy->per_work_column
+            = &columns.add(header_name(header) + "_energy_per_" + header_name(work_col.getHeader()) + "/J");
+    }
+
+    unsigned order = src.getOrder();
+    if (energies_by_order.size() <= order)
+        energies_by_order.resize(order + 1);
+    energies_by_order[order].push_back(energy.get());
+    energies.push_back(move(energy));
+}
+
+void Rates::Counter::add(double v, double t)
+{
+    if (t <= time)
+        return; // Already observed
+    value = v;
+    time = t;
+    if (isnan(period_time)) {
+        period_value = v;
+        period_time = t;
+    }
+}
+
+double Rates::Counter::delta()
+{
+    if (isnan(time) || time <= period_time)
+        return NAN;
+    double d = value - period_value;
+    period_value = value;
+    period_time = time;
+    return d;
+}
+
+void Rates::Energy::add(double p, double t)
+{
+    if (t <= time)
+        return; // Already observed
+    if (isnan(energy))
+        energy = period_energy = 0;
+    else
+        energy += (power + p) / 2 * scale * (t - time) / 1000;
+    power = p;
+    time = t;
+}
+
+void Rates::add(const CsvRow &row)
+{
+    double time = NAN;
+
+    for (unsigned order : row.getFilled()) {
+        bool counter = order < counters_by_order.size() && !counters_by_order[order].empty();
+        bool energy = order < energies_by_order.size() && !energies_by_order[order].empty();
+        if (!counter && !energy)
+            continue;
+
+        double v = row.getNumber(order);
+        if (isnan(v))
+            continue;
+        if (isnan(time))
+            time = row.getNumber(time_column.getOrder());
+
+        if (counter)
+            for (Counter *c : counters_by_order[order])
+                c->add(v, time);
+        if (energy)
+            for (Energy *e : energies_by_order[order])
+                e->add(v, time);
+    }
+}
+
+void Rates::set(CsvRow &row)
+{
+    for (const RateOutput &r : rates) {
+        double period_time = r.counter->period_time;
+        double d = r.counter->delta();
+        if (!isnan(d))
+            row.setExact(r.column, d / (r.counter->time - period_time) * 1000);
+    }
+
+    for (auto &e : energies) {
+        if (isnan(e->energy))
+            continue;
+        row.setExact(e->column, e->energy);
+        if (e->work) {
+            double work = e->work->delta();
+            if (!isnan(work) && work != 0)
+                row.setExact(*e->per_work_column, (e->energy - e->period_energy) / work);
+            if (!isnan(work))
+                e->period_energy = e->energy;
+        }
+    }
+}
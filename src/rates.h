@@ -0,0 +1,99 @@
+#ifndef RATES_H
+#define RATES_H
+
+#include "csvRow.h"
+#include <math.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Online computation of counter rates and energy. Values of the
+// source columns are observed in all rows as they are produced. Once
+// per period, the per-period rates, the energy integrated so far and
+// the energy per unit of work are stored to the (periodic) row. All
+// operations take constant time per value.
+class Rates {
+public:
+    Rates(CsvColumns &columns, const CsvColumn &time_column)
+        : columns(columns)
+        , time_column(time_column)
+    {
+    }
+
+    Rates(const Rates &) = delete;
+    void operator=(const Rates &) = delete;
+
+    // Add column COL_rate with the per-second rate of counter COL
+    void addRate(const string &col);
+    // Add column POWER_energy/J with the trapezoidal integral of
+    // POWER and, if work is not empty, POWER_energy_per_WORK/J with
+    // the energy consumed per unit of counter WORK in each period.
+    void addEnergy(const string &power, const string &work);
+
+    // Observe the values of the row. Rows with the same time are
+    // observed only once.
+    void add(const CsvRow &row);
+
+    // Store values for the period ending now
+    void set(CsvRow &row);
+
+    bool empty() const { return counters.empty() && energies.empty(); }
+
+    // Source columns of the counters (--rate COL and --energy WORK)
+    vector<const CsvColumn *> counterColumns() const;
+
+private:
+    struct Counter {
+        const CsvColumn &src;
+        double value = NAN, time = NAN; // Last observed
+        double period_value = NAN, period_time = NAN; // At the end of previous period
+
+        Counter(const CsvColumn &src)
+            : src(src)
+        {
+        }
+        void add(double v, double t);
+        // Advance the period, return the change of the value
+        double delta();
+    };
+    struct RateOutput {
+        Counter *counter;
+        const CsvColumn &column;
+    };
+    struct Energy {
+        const CsvColumn &src;
+        const double scale; // Power unit to W
+        const CsvColumn &column;
+        Counter *work;
+        const CsvColumn *per_work_column;
+        double power = NAN, time = NAN; // Last observed
+        double energy = NAN; // Integrated energy [J]
+        double period_energy = NAN; // At the end of previous period
+
+        Energy(const CsvColumn &src, double scale, const CsvColumn &column)
+            : src(src)
+            , scale(scale)
+            , column(column)
+            , work(nullptr)
+            , per_work_column(nullptr)
+        {
+        }
+        Energy(const Energy &) = delete;
+        void operator=(const Energy &) = delete;
+        void add(double p, double t);
+    };
+
+    CsvColumns &columns;
+    const CsvColumn &time_column;
+    vector<unique_ptr<Counter>> counters = {};
+    vector<RateOutput> rates = {};
+    vector<unique_ptr<Energy>> energies = {};
+    vector<vector<Counter *>> counters_by_order = {};
+    vector<vector<Energy *>> energies_by_order = {};
+
+    const CsvColumn &findColumn(const string &name, const char *opt);
+    // Each output has its own counter to track its own periods
+    Counter *addCounter(const CsvColumn &src);
+};
+
+#endif
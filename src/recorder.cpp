@@ -0,0 +1,65 @@
+#include "recorder.h"
+#include <stdlib.h>
+
+FlightRecorder::FlightRecorder(const CsvColumns &columns, const CsvColumn &time_column, double pre_ms,
+                               double post_ms, size_t capacity)
+    : time_column(time_column)
+    , pre_ms(pre_ms)
+    , post_ms(post_ms)
+    , ring(capacity, CsvRow(columns))
+    , times(capacity)
+{
+}
+
+void FlightRecorder::add(const CsvRow &row, Sink sink)
+{
+    last_time = row.getNumber(time_column.getOrder());
+
+    if (triggered()) {
+        sink(row);
+        return;
+    }
+
+    // Drop rows that are too old
+    while (count > 0 && times[head] < last_time - pre_ms) {
+        head = (head + 1) % ring.size();
+        count--;
+    }
+
+    if (count == ring.size())
+        grow();
+
+    // Assignment reuses the memory of the previously stored row
+    size_t tail = (head + count) % ring.size();
+    ring[tail] = row;
+    times[tail] = last_time;
+    count++;
+}
+
+void FlightRecorder::trigger(Sink sink)
+{
+    for (; count > 0; count--) {
+        sink(ring[head]);
+        head = (head + 1) % ring.size();
+    }
+    post_until = last_time + post_ms;
+}
+
+// The preallocated capacity was not sufficient for pre_ms (e.g. the
+// COMMAND produces more rows than expected). Double the capacity.
+void FlightRecorder::grow()
+{
+    vector<CsvRow> r;
+    vector<double> t;
+    r.reserve(2 * ring.size());
+    t.reserve(2 * ring.size());
+    for (size_t i = 0; i < count; i++) {
+        r.push_back(move(ring[(head + i) % ring.size()]));
+        t.push_back(times[(head + i) % ring.size()]);
+    }
+    r.resize(2 * ring.size(), r.front());
+    t.resize(2 * ring.size());
+    ring = move(r);
+    times = move(t);
+    head = 0;
+}
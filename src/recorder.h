@@ -0,0 +1,39 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "csvRow.h"
+#include <vector>
+
+// Flight recorder keeps the rows of the last pre_ms milliseconds in
+// memory instead of writing them out. When triggered, the kept rows
+// are written out together with all rows received during the
+// following post_ms milliseconds.
+class FlightRecorder {
+public:
+    using Sink = void (*)(const CsvRow &row);
+
+    FlightRecorder(const CsvColumns &columns, const CsvColumn &time_column, double pre_ms, double post_ms,
+                   size_t capacity);
+
+    // Store the row or pass it to sink if we are after a trigger
+    void add(const CsvRow &row, Sink sink);
+
+    // Write out the stored rows and pass the rows of the next post_ms
+    // to the sink
+    void trigger(Sink sink);
+
+    bool triggered() const { return last_time < post_until; }
+
+private:
+    const CsvColumn &time_column;
+    const double pre_ms, post_ms;
+    vector<CsvRow> ring;
+    vector<double> times;
+    size_t head = 0, count = 0; // Index of the oldest row and number of rows
+    double last_time = 0;
+    double post_until = -1;
+
+    void grow();
+};
+
+#endif
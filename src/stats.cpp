@@ -0,0 +1,239 @@
+#include "stats.h"
+#include <err.h>
+#include <stdlib.h>
+
+void Welford::add(double x)
+{
+    count++;
+    double delta = x - mean;
+    mean += delta / count;
+    m2 += delta * (x - mean);
+    if (x < min)
+        min = x;
+    if (x > max)
+        max = x;
+    last = x;
+}
+
+// Two-sided 95% quantile of Student's t-distribution with n degrees
+// of freedom. Exact for n <= 2, Cornish-Fisher expansion otherwise
+// (error < 0.005).
+static double t_quantile_95(unsigned long n)
+{
+    const double z = 1.959963984540054, p = 0.975;
+
+    if (n == 1)
+        return tan(M_PI * (p - 0.5));
+    if (n == 2)
+        return (2 * p - 1) / sqrt(2 * p * (1 - p));
+
+    double z2 = z * z, z3 = z2 * z, z5 = z3 * z2, z7 = z5 * z2, z9 = z7 * z2;
+    double dn = n;
+    return z + (z3 + z) / (4 * dn) + (5 * z5 + 16 * z3 + 3 * z) / (96 * dn * dn)
+        + (3 * z7 + 19 * z5 + 17 * z3 - 15 * z) / (384 * dn * dn * dn)
+        + (79 * z9 + 776 * z7 + 1482 * z5 - 1920 * z3 - 945 * z) / (92160 * dn * dn * dn * dn);
+}
+
+double Welford::interval() const
+{
+    if (count == 0)
+        return NAN;
+    if (count == 1)
+        return INFINITY;
+    return sqrt(variance()) * t_quantile_95(count - 1);
+}
+
+RunStats::RunStats(const CsvColumns &columns, const CsvColumn &time_column,
+                   const vector<const CsvColumn *> &counters, const vector<Condition> &thresholds)
+    : columns(columns)
+    , time_column(time_column)
+    , stats()
+    , thresholds()
+{
+    addColumns();
+    for (const CsvColumn *c : counters)
+        stats[c->getOrder()].is_counter = true;
+    for (const Condition &c : thresholds)
+        this->thresholds.push_back({ c, NAN });
+}
+
+// Initialize statistics of columns added since the last call
+void RunStats::addColumns()
+{
+    size_t first = stats.size();
+    stats.resize(columns.count());
+    for (const CsvColumn &col : columns) {
+        if (col.getOrder() < first)
+            continue;
+        Column &s = stats[col.getOrder()];
+        s.column = &col;
+    }
+}
+
+void RunStats::add(const CsvRow &row)
+{
+    double time = row.getNumber(time_column.getOrder());
+
+    if (stats.size() < columns.count())
+        addColumns();
+    for (unsigned order : row.getFilled()) {
+        if (order == time_column.getOrder() || order >= stats.size())
+            continue;
+        double v = row.getNumber(order);
+        if (isnan(v))
+            continue;
+
+        Column &s = stats[order];
+        if (s.is_counter && s.values.count > 0 && time > s.prev_time)
+            s.rates.add((v - s.values.last) / (time - s.prev_time) * 1000);
+        s.values.add(v);
+        s.prev_time = time;
+    }
+
+    for (Threshold &t : thresholds)
+        if (isnan(t.time) && t.condition.eval(row))
+            t.time = time;
+}
+
+void RunStats::ops(double &sum, double &interval) const
+{
+    double var = 0;
+    sum = interval = NAN;
+    for (const Column &s : stats) {
+        if (!s.is_counter || s.rates.count == 0)
+            continue;
+        if (isnan(sum))
+            sum = var = 0;
+        // Errors of independent estimates add in quadrature (as in
+        // Measurements.jl)
+        sum += s.rates.mean;
+        var += s.rates.interval() * s.rates.interval();
+    }
+    if (!isnan(sum))
+        interval = sqrt(var);
+}
+
+void RunStats::write(const string &file, const string &comment) const
+{
+    FILE *fp = fopen(file.c_str(), "w");
+    if (!fp)
+        err(1, "fopen(%s)", file.c_str());
+
+    if (file.size() >= 5 && file.compare(file.size() - 5, 5, ".json") == 0)
+        writeJson(fp, comment);
+    else
+        writeKeyValue(fp, comment);
+
+    if (fclose(fp) != 0)
+        err(1, "fclose(%s)", file.c_str());
+}
+
+void RunStats::writeKeyValue(FILE *fp, const string &comment) const
+{
+    fprintf(fp, "# %s\n", comment.c_str());
+    for (const Column &s : stats) {
+        if (s.values.count == 0)
+            continue;
+        const char *name = s.column->getHeader().c_str();
+        fprintf(fp, "%s.count=%lu\n", name, s.values.count);
+        fprintf(fp, "%s.mean=%.15g\n", name, s.values.mean);
+        fprintf(fp, "%s.variance=%.15g\n", name, s.values.variance());
+        fprintf(fp, "%s.min=%.15g\n", name, s.values.min);
+        fprintf(fp, "%s.max=%.15g\n", name, s.values.max);
+        fprintf(fp, "%s.last=%.15g\n", name, s.values.last);
+        if (s.rates.count > 0) {
+            fprintf(fp, "%s.rate=%.15g\n", name, s.rates.mean);
+            fprintf(fp, "%s.rate_interval=%.15g\n", name, s.rates.interval());
+        }
+    }
+    double sum, interval;
+    ops(sum, interval);
+    if (!isnan(sum)) {
+        fprintf(fp, "ops=%.15g\n", sum);
+        fprintf(fp, "ops_interval=%.15g\n", interval);
+    }
+    for (const Threshold &t : thresholds)
+        fprintf(fp, "first_time.%s=%.15g\n", t.condition.spec.c_str(), t.time);
+}
+
+static void json_string(FILE *fp, const string &s)
+{
+    fputc('"', fp);
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+// JSON has no representation of NaN and infinity
+static void json_number(FILE *fp, double v)
+{
+    if (isfinite(v))
+        fprintf(fp, "%.15g", v);
+    else
+        fputs("null", fp);
+}
+
+void RunStats::writeJson(FILE *fp, const string &comment) const
+{
+    fputs("{\n  \"comment\": ", fp);
+    json_string(fp, comment);
+    fputs(",\n  \"columns\": {", fp);
+    const char *sep = "\n";
+    for (const Column &s : stats) {
+        if (s.values.count == 0)
+            continue;
+        fprintf(fp, "%s    ", sep);
+        json_string(fp, s.column->getHeader());
+        fprintf(fp, ": { \"count\": %lu", s.values.count);
+        const struct {
+            const char *key;
+            double value;
+        } fields[] = {
+            { "mean", s.values.mean }, { "variance", s.values.variance() },
+            { "min", s.values.min },   { "max", s.values.max },
+            { "last", s.values.last },
+        };
+        for (const auto &f : fields) {
+            fprintf(fp, ", \"%s\": ", f.key);
+            json_number(fp, f.value);
+        }
+        if (s.rates.count > 0) {
+            fputs(", \"rate\": ", fp);
+            json_number(fp, s.rates.mean);
+            fputs(", \"rate_interval\": ", fp);
+            json_number(fp, s.rates.interval());
+        }
+        fputs(" }", fp);
+        sep = ",\n";
+    }
+    fputs("\n  }", fp);
+
+    double sum, interval;
+    ops(sum, interval);
+    if (!isnan(sum)) {
+        fputs(",\n  \"ops\": ", fp);
+        json_number(fp, sum);
+        fputs(",\n  \"ops_interval\": ", fp);
+        json_number(fp, interval);
+    }
+
+    if (!thresholds.empty()) {
+        fputs(",\n  \"first_time\": {", fp);
+        sep = "\n";
+        for (const Threshold &t : thresholds) {
+            fprintf(fp, "%s    ", sep);
+            json_string(fp, t.condition.spec);
+            fputs(": ", fp);
+            json_number(fp, t.time);
+            sep = ",\n";
+        }
+        fputs("\n  }", fp);
+    }
+    fputs("\n}\n", fp);
+}
@@ -0,0 +1,66 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "condition.h"
+#include "csvRow.h"
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Running mean and variance (Welford's algorithm)
+struct Welford {
+    unsigned long count = 0;
+    double mean = 0;
+    double m2 = 0;
+    double min = INFINITY;
+    double max = -INFINITY;
+    double last = NAN;
+
+    void add(double x);
+    double variance() const { return count > 1 ? m2 / (count - 1) : NAN; }
+    // Half-width of the interval mean ± t·σ (95%), as calculated by
+    // sample_mean_est() of the Julia package
+    double interval() const;
+};
+
+// Statistics of the whole run collected from all rows and written to
+// a sidecar file at the end. Besides per-column statistics, rates of
+// counter columns are estimated like ops_est() in the Julia package.
+class RunStats {
+public:
+    RunStats(const CsvColumns &columns, const CsvColumn &time_column,
+             const vector<const CsvColumn *> &counters, const vector<Condition> &thresholds);
+
+    void add(const CsvRow &row);
+
+    // JSON is written if file name ends with .json, key=value lines
+    // otherwise
+    void write(const string &file, const string &comment) const;
+
+private:
+    struct Column {
+        const CsvColumn *column = nullptr;
+        Welford values = {};
+        bool is_counter = false;
+        Welford rates = {}; // Per-second rates between consecutive values (counters only)
+        double prev_time = NAN;
+    };
+    struct Threshold {
+        Condition condition;
+        double time;
+    };
+
+    const CsvColumns &columns;
+    const CsvColumn &time_column;
+    vector<Column> stats; // Indexed by column order
+    vector<Threshold> thresholds;
+
+    void addColumns();
+    void writeKeyValue(FILE *fp, const string &comment) const;
+    void writeJson(FILE *fp, const string &comment) const;
+    // Sum of counter rates and its interval
+    void ops(double &sum, double &interval) const;
+};
+
+#endif
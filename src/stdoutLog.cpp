@@ -0,0 +1,87 @@
+#include "stdoutLog.h"
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+StdoutLog::StdoutLog(const string &file, double index_period_ms)
+    : file(file)
+    , index_period_ms(index_period_ms)
+    , fd(open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666))
+{
+    if (fd == -1)
+        err(1, "open(%s)", file.c_str());
+
+    const string idx = file + ".idx";
+    index = fopen(idx.c_str(), "w");
+    if (!index)
+        err(1, "fopen(%s)", idx.c_str());
+    fprintf(index, "time/ms,offset\n");
+}
+
+StdoutLog::~StdoutLog()
+{
+    close(fd);
+    if (pipe_r != -1) {
+        close(pipe_r);
+        close(pipe_w);
+    }
+    if (fclose(index) != 0)
+        warn("fclose(%s.idx)", file.c_str());
+}
+
+void StdoutLog::indexChunk(double time)
+{
+    if (time - index_time < index_period_ms)
+        return;
+    fprintf(index, "%g,%lld\n", time, (long long)offset);
+    index_time = time;
+}
+
+ssize_t StdoutLog::move(int from, double time)
+{
+    ssize_t len = splice(from, NULL, fd, NULL, 0x10000, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (len == -1) {
+        if (errno == EAGAIN)
+            return -1;
+        err(1, "splice(%s)", file.c_str());
+    }
+    if (len > 0) {
+        indexChunk(time);
+        offset += len;
+    }
+    return len;
+}
+
+size_t StdoutLog::tee(int from, size_t max, double time)
+{
+    if (ahead > 0)
+        return ahead < max ? ahead : max;
+
+    if (pipe_r == -1) {
+        int p[2];
+        if (pipe2(p, O_CLOEXEC) == -1)
+            err(1, "pipe");
+        pipe_r = p[0];
+        pipe_w = p[1];
+    }
+
+    ssize_t len = ::tee(from, pipe_w, 0x10000, SPLICE_F_NONBLOCK);
+    if (len == -1 && errno != EAGAIN)
+        err(1, "tee(%s)", file.c_str());
+    if (len == -1)
+        return 0; // No data yet - data read now would miss the log
+    if (len == 0)
+        return max; // End of file - let the caller's read() find out
+
+    indexChunk(time);
+    for (ssize_t left = len; left > 0;) {
+        ssize_t ret = splice(pipe_r, NULL, fd, NULL, left, SPLICE_F_MOVE);
+        if (ret <= 0)
+            err(1, "splice(%s)", file.c_str());
+        left -= ret;
+    }
+    offset += len;
+    ahead = len;
+    return ahead < max ? ahead : max;
+}
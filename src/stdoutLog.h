@@ -0,0 +1,52 @@
+#ifndef STDOUTLOG_H
+#define STDOUTLOG_H
+
+#include <stdio.h>
+#include <string>
+#include <sys/types.h>
+
+using namespace std;
+
+// Raw copy of the COMMAND stdout. Data is moved from the pipe to the
+// file by splice(), so it does not pass through user space at all.
+// When the data is also parsed for keys, it is duplicated by tee()
+// and the caller reads the original.
+//
+// Records "time,offset" are written to FILE.idx (at most one per
+// index period), so that lines in the log can be mapped to the CSV
+// time.
+class StdoutLog {
+public:
+    StdoutLog(const string &file, double index_period_ms);
+    ~StdoutLog();
+
+    StdoutLog(const StdoutLog &) = delete;
+    void operator=(const StdoutLog &) = delete;
+
+    // Move data available in pipe fd to the log. Return the number of
+    // bytes moved, 0 at the end of file and -1 if there was no data.
+    ssize_t move(int fd, double time);
+
+    // Duplicate data available in pipe fd to the log (unless already
+    // done) and return how many of max bytes the caller can read from
+    // fd. Return 0 if fd has no data yet and max at the end of file.
+    // Must be followed by consumed() with the amount read.
+    size_t tee(int fd, size_t max, double time);
+    void consumed(size_t len) { ahead -= len < ahead ? len : ahead; }
+
+    void flush() { fflush(index); }
+
+private:
+    const string file;
+    const double index_period_ms;
+    int fd;
+    int pipe_r = -1, pipe_w = -1; // For tee()
+    FILE *index = nullptr;
+    off_t offset = 0;
+    double index_time = -1e300;
+    size_t ahead = 0; // Bytes duplicated by tee() but not yet consumed
+
+    void indexChunk(double time);
+};
+
+#endif
@@ -7,15 +7,33 @@
 //          Michal Sojka <michal.sojka@cvut.cz>
 //
 #define _POSIX_C_SOURCE 200809L
+#include "aggregate.h"
+#include "capture.h"
+#include "csvOutput.h"
+#include "condition.h"
+#include "counters.h"
 #include "csvRow.h"
+#include "expr.h"
+#include "filter.h"
+#include "keyIndex.h"
+#include "lineBuffer.h"
+#include "metrics.h"
+#include "publisher.h"
+#include "rates.h"
+#include "recorder.h"
 #include "sched_deadline.h"
+#include "stats.h"
+#include "stdoutLog.h"
+#include "trace.h"
 #include "util.hpp"
 #include <algorithm>
+#include <charconv>
 #include <argp.h>
 #include <err.h>
 #include <errno.h>
-#include <ext/stdio_filebuf.h>
 #include <fcntl.h>
+#include <fnmatch.h>
+#include <fstream>
 #include <iostream>
 #include <libgen.h>
 #include <math.h>
@@ -23,6 +41,7 @@
 #include <memory>
 #include <sched.h>
 #include <signal.h>
+#include <stddef.h>
 #include <sstream>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,6 +49,8 @@
 #include <string>
 #include <string_view>
 #include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
@@ -102,8 +123,8 @@ using namespace std;
 #define MAX_RESULTS 100
 #define MAX_KEYS 20
 #define MAX_KEY_LENGTH 50
-
-using buffer_t = vector<char, default_init_allocator<char>>;
+#define MAX_LINE_LENGTH 0x10000
+#define MAX_UNMATCHED_KEYS 10000
 
 CsvColumns columns;
 
@@ -112,6 +133,7 @@ struct sensor {
     string name;
     const string units;
     const CsvColumn &column;
+    int oversampler = -1; // Index to state.oversamplers or -1
     sensor(const char *spec)
         : path(extractPath(spec))
         , name(extractName(spec))
@@ -168,6 +190,35 @@ bool exec_wait = false;
 bool verbose = false;
 bool verbose_needs_eol = false;
 bool csv_unbuffered = false;
+bool merge_rows = true;
+CsvOutput::Format out_format = CsvOutput::WIDE;
+double window_ms = 0;
+char *window_file = NULL;
+vector<AggFunc> window_funcs = { AggFunc::MIN, AggFunc::MAX, AggFunc::MEAN, AggFunc::LAST };
+Aggregator::Specs window_specs;
+double recorder_pre_ms = 0;
+double recorder_post_ms = NAN;
+vector<string> dump_conditions;
+off_t rotate_bytes = 0;
+double rotate_ms = 0;
+char *publish_path = NULL;
+char *metrics_addr = NULL;
+vector<string> oversample_specs;
+vector<string> derive_specs;
+vector<string> rate_specs;
+vector<string> energy_specs;
+char *stats_file = NULL;
+vector<string> stats_first_specs;
+vector<string> trigger_specs;
+bool trace_marker = false;
+char *trace_marker_path = NULL;
+char *capture_file = NULL;
+bool shared_counters = false;
+char *replay_file = NULL;
+char *stdout_log_file = NULL;
+cpu_set_t benchmark_cpus;
+bool benchmark_affinity = false;
+bool wait_all = false;
 bool sched_deadline = false;
 float sched_deadline_budget = 1.0; // %
 
@@ -175,26 +226,51 @@ struct StdoutKeyColumn {
     const CsvColumn &column;
     const string key;
     const bool synchronous; // Value stored every --period, not immediately
+    const bool aggregated;  // Values aggregated by func over --period (implies synchronous)
+    const AggFunc func;
     string last_value = ""; // Last value (for synchronous columns)
+    Accumulator acc = {};   // Values since the last --period (for aggregated columns)
+    unsigned long malformed = 0; // Number of malformed numeric values
     StdoutKeyColumn(const string header, const string key, bool synchronous)
         : column(columns.add(header))
         , key(key)
-        , synchronous(synchronous) {};
+        , synchronous(synchronous)
+        , aggregated(false)
+        , func(AggFunc::LAST) {};
+    StdoutKeyColumn(const string name, const string key, AggFunc func)
+        : column(columns.add(aggHeader(name, func)))
+        , key(key)
+        , synchronous(true)
+        , aggregated(true)
+        , func(func) {};
+};
+
+// Pattern of --column keys (see find_stdout_key)
+struct KeyPattern {
+    string pattern;
+    string func; // ":FUNC" suffix of the spec or empty
 };
 
+vector<string> split_words(const string str);
 vector<string> split(const string str, const char *delimiters);
+StdoutKeyColumn key_column(const string &spec, bool has_key, bool synchronous);
+vector<StdoutKeyColumn> parse_key_columns(const string &arg, const char *opt);
+StdoutKeyColumn *find_catch_all_col(vector<StdoutKeyColumn> &keys);
+KeyIndex index_keys(const vector<StdoutKeyColumn> &keys);
 
 struct Exec {
     const string cmd;
     vector<StdoutKeyColumn> columns;
     StdoutKeyColumn *const stdout_col;
     const bool has_sync_column;
+    const KeyIndex key_index;
 
     Exec(const string &arg)
         : cmd(parse_cmd(arg))
         , columns(parse_columns(arg))
-        , stdout_col(find_stdout_col(columns))
+        , stdout_col(find_catch_all_col(columns))
         , has_sync_column(any_of(begin(columns), end(columns), [](const auto &c) { return c.synchronous; }))
+        , key_index(index_keys(columns))
     {
     }
 
@@ -203,14 +279,16 @@ struct Exec {
 
     void start(ev::loop_ref loop);
     void kill();
+    // Process a chunk of stdout received at curr_time
+    void process(const char *data, size_t len, double curr_time);
+
+    unsigned index = 0; // Capture source index
 
 private:
-    static vector<string> get_specs(const string &arg);
     static const string parse_cmd(const string &arg);
     static vector<StdoutKeyColumn> parse_columns(const string &arg);
-    static StdoutKeyColumn *find_stdout_col(vector<StdoutKeyColumn> &keys);
     pid_t pid = 0;
-    unique_ptr<__gnu_cxx::stdio_filebuf<char>> buf = nullptr;
+    LineBuffer lines = LineBuffer(MAX_LINE_LENGTH);
     ev::child child = {};
     ev::io child_stdout = {};
 
@@ -230,48 +308,68 @@ const string Exec::parse_cmd(const string &arg)
     return cmd;
 }
 
-vector<string> Exec::get_specs(const string &arg)
+// Parse the "(COL[,...])" prefix of arg
+vector<StdoutKeyColumn> parse_key_columns(const string &arg, const char *opt)
 {
     size_t spec_end = arg.find_first_of(")");
     if (spec_end == string::npos)
-        errx(1, "--exec: Missing ')'");
+        errx(1, "%s: Missing ')'", opt);
 
     vector<string> specs = split(arg.substr(1, spec_end - 1), ",");
     if (specs.empty())
-        errx(1, "--exec: No columns specified");
-    return specs;
+        errx(1, "%s: No columns specified", opt);
+
+    vector<StdoutKeyColumn> keys;
+    const StdoutKeyColumn *catch_all = nullptr;
+
+    for (string spec : specs) {
+        bool synchronous = spec.front() == '@';
+        if (synchronous)
+            spec.erase(0, 1); // Remove '@'
+        if (spec.back() == '=') {
+            spec.pop_back(); // Remove '='
+            keys.push_back(key_column(spec, true, synchronous));
+        } else {
+            if (catch_all != nullptr)
+                errx(1, "%s: At most one COL without '=' allowed", opt);
+            keys.push_back(key_column(spec, false, synchronous));
+            catch_all = &keys.back();
+        }
+    }
+    return keys;
 }
 
-vector<StdoutKeyColumn> Exec::parse_columns(const string &arg)
+// Position of the ":FUNC" suffix of a key spec or npos. Other colons
+// are part of the key (e.g. host:temp).
+static size_t agg_suffix(const string &spec)
 {
-    vector<StdoutKeyColumn> keys;
+    size_t colon = spec.rfind(':');
+    return colon != string::npos && isAggFunc(spec.substr(colon + 1)) ? colon : string::npos;
+}
+
+// Create the column for spec NAME[:FUNC]. The key is NAME if has_key
+// is true. With FUNC, the values are aggregated over --period.
+StdoutKeyColumn key_column(const string &spec, bool has_key, bool synchronous)
+{
+    size_t colon = agg_suffix(spec);
+    if (colon == string::npos)
+        return StdoutKeyColumn(spec, has_key ? spec : "", synchronous);
 
-    if (arg[0] == '(') {
-        vector<string> specs = get_specs(arg);
+    const string name = spec.substr(0, colon);
+    return StdoutKeyColumn(name, has_key ? name : "", parseAggFunc(spec.substr(colon + 1)));
+}
 
-        const StdoutKeyColumn *catch_all = nullptr;
+vector<StdoutKeyColumn> Exec::parse_columns(const string &arg)
+{
+    if (arg[0] == '(')
+        return parse_key_columns(arg, "--exec");
 
-        for (string spec : specs) {
-            bool synchronous = spec.front() == '@';
-            if (synchronous)
-                spec.erase(0, 1); // Remove '@'
-            if (spec.back() == '=') {
-                spec.pop_back(); // Remove '='
-                keys.push_back(StdoutKeyColumn(spec, spec, synchronous));
-            } else {
-                if (catch_all != nullptr)
-                    errx(1, "--exec: At most one COL without '=' allowed");
-                keys.push_back(StdoutKeyColumn(spec, "", synchronous));
-                catch_all = &keys.back();
-            }
-        }
-    } else {
-        keys.push_back(StdoutKeyColumn(arg.substr(0, arg.find_first_of(" \t")), "", false));
-    }
+    vector<StdoutKeyColumn> keys;
+    keys.push_back(StdoutKeyColumn(arg.substr(0, arg.find_first_of(" \t")), "", false));
     return keys;
 }
 
-StdoutKeyColumn *Exec::find_stdout_col(vector<StdoutKeyColumn> &columns)
+StdoutKeyColumn *find_catch_all_col(vector<StdoutKeyColumn> &columns)
 {
     for (auto &col : columns)
         if (col.key.empty())
@@ -279,18 +377,220 @@ StdoutKeyColumn *Exec::find_stdout_col(vector<StdoutKeyColumn> &columns)
     return nullptr;
 }
 
+KeyIndex index_keys(const vector<StdoutKeyColumn> &columns)
+{
+    vector<string_view> keys;
+    for (const auto &col : columns)
+        keys.push_back(col.key);
+    KeyIndex index;
+    index.build(keys);
+    return index;
+}
+
+// Reads KEY=value lines from a Unix domain socket, e.g. from
+// utils/sensord, and reconnects whenever the connection is lost.
+struct SocketSource {
+    const string path;
+    vector<StdoutKeyColumn> columns;
+    StdoutKeyColumn *const catch_all;
+    const bool has_sync_column;
+    const KeyIndex key_index;
+
+    SocketSource(const string &arg)
+        : path(parse_path(arg))
+        , columns(parse_key_columns(arg, "--socket"))
+        , catch_all(find_catch_all_col(columns))
+        , has_sync_column(any_of(begin(columns), end(columns), [](const auto &c) { return c.synchronous; }))
+        , key_index(index_keys(columns))
+    {
+    }
+
+    SocketSource(const SocketSource &) = delete;
+    void operator=(const SocketSource &) = delete;
+
+    void start(ev::loop_ref loop);
+    void stop();
+    // Process a chunk of data received at curr_time
+    void process(const char *data, size_t len, double curr_time);
+
+    unsigned index = 0; // Capture source index
+
+private:
+    static const string parse_path(const string &arg);
+    static constexpr double reconnect_delay = 1.0; // seconds
+    LineBuffer lines = LineBuffer(MAX_LINE_LENGTH);
+    bool report_errors = true; // Cleared after reporting a connection failure
+    ev::io io = {};
+    ev::timer reconnect_timer = {};
+
+    void connect();
+    void connected(int fd);
+    void connect_failed(int fd, int error);
+    void disconnect();
+    void connect_cb(ev::io &w, int revents);
+    void read_cb(ev::io &w, int revents);
+    void reconnect_cb(ev::timer &w, int revents);
+};
+
+const string SocketSource::parse_path(const string &arg)
+{
+    if (arg[0] != '(')
+        errx(1, "--socket: Missing column specification");
+    string path = arg.substr(arg.find_first_of(")") + 1);
+    if (path.empty())
+        errx(1, "--socket: No socket path");
+    return path;
+}
+
+// Samples a sensor faster than --period and filters the samples
+struct Oversampler {
+    const unsigned sensor_idx;
+    const double period_ms;
+    Filter filter;
+    ev::timer timer = {};
+
+    Oversampler(unsigned sensor_idx, double period_ms, const Filter &filter)
+        : sensor_idx(sensor_idx)
+        , period_ms(period_ms)
+        , filter(filter)
+    {
+    }
+
+    Oversampler(const Oversampler &) = delete;
+    void operator=(const Oversampler &) = delete;
+
+    static Oversampler *parse(const string &spec);
+    void start(ev::loop_ref loop);
+    double output();
+
+private:
+    void timer_cb(ev::timer &w, int revents);
+};
+
+// Action executed when a condition on a column value starts to hold
+struct Trigger {
+    enum Action { ABORT, FAN, MARK, EXEC };
+
+    Condition condition;
+    Action action;
+    string arg; // FAN: speed, MARK: text, EXEC: command
+    bool holds = false;
+
+    static Trigger parse(const string &spec, const CsvColumns &columns);
+};
+
+Trigger Trigger::parse(const string &spec, const CsvColumns &columns)
+{
+    size_t colon = spec.find(':');
+    if (colon == string::npos)
+        errx(1, "--trigger: Missing ':ACTION' in %s", spec.c_str());
+
+    string action = spec.substr(colon + 1);
+    size_t eq = action.find('=');
+    string name = action.substr(0, eq);
+    string arg = eq == string::npos ? "" : action.substr(eq + 1);
+    Condition condition = Condition::parse(spec.substr(0, colon), columns);
+
+    if (name == "abort")
+        return { condition, ABORT, arg };
+    if (name == "fan") {
+        if (!fan_cmd)
+            errx(1, "--trigger: Action fan requires --fan-cmd");
+        if (arg.empty())
+            errx(1, "--trigger: Missing fan speed in %s", spec.c_str());
+        return { condition, FAN, arg };
+    }
+    if (name == "mark")
+        return { condition, MARK, arg.empty() ? condition.spec : arg };
+    if (name == "exec") {
+        if (arg.empty())
+            errx(1, "--trigger: Missing command in %s", spec.c_str());
+        return { condition, EXEC, arg };
+    }
+    errx(1, "--trigger: Unknown action: %s", action.c_str());
+}
+
+struct Derived {
+    const CsvColumn &column;
+    Expr expr;
+};
+
+// Benchmark run concurrently with COMMAND (--corun). Its KEY=value
+// lines are looked up as PREFIX_KEY.
+struct Corun {
+    const string prefix;
+    const string cmd;
+    cpu_set_t cpus = {};
+    bool has_affinity = false;
+
+    Corun(const string &arg);
+    Corun(const string &prefix, const string &cmd)
+        : prefix(prefix)
+        , cmd(cmd)
+    {
+    }
+
+    Corun(const Corun &) = delete;
+    void operator=(const Corun &) = delete;
+
+    void start(ev::loop_ref loop);
+    // Send SIGTERM to the process group. Return false if not running.
+    bool kill();
+    // Process a chunk of stdout received at curr_time
+    void process(const char *data, size_t len, double curr_time);
+
+    unsigned index = 0; // Capture source index (COMMAND is 0)
+
+private:
+    static const string parse_prefix(const string &arg);
+    pid_t pid = 0;
+    LineBuffer lines = LineBuffer(MAX_LINE_LENGTH);
+    ev::child child = {};
+    ev::io child_stdout = {};
+
+    void child_stdout_cb(ev::io &w, int revents);
+    void child_exit_cb(ev::child &w, int revents);
+};
+
 struct measure_state {
     struct timespec start_time = { 0 };
     vector<sensor> sensors = {};
-    FILE *out_fp = nullptr;
+    unique_ptr<CsvOutput> out = nullptr;
+    unique_ptr<CsvOutput> window_out = nullptr;
+    unique_ptr<Aggregator> aggregator = nullptr;
+    unique_ptr<FlightRecorder> recorder = nullptr;
+    vector<Condition> dump_conditions = {};
+    unique_ptr<Publisher> publisher = nullptr;
+    unique_ptr<MetricsServer> metrics = nullptr;
+    string header_comment = "";
     vector<StdoutKeyColumn> stdoutColumns = {};
+    KeyIndex stdoutIndex = {};
+    vector<KeyPattern> stdoutPatterns = {};
+    KeyIndex stdoutUnmatched = {};      // Keys known not to match any pattern
     vector<unique_ptr<Exec>> execs = {};
+    vector<unique_ptr<Corun>> coruns = {};
+    vector<unique_ptr<SocketSource>> sockets = {};
+    vector<unique_ptr<Oversampler>> oversamplers = {};
+    vector<Derived> derived = {};
+    unique_ptr<Rates> rates = nullptr;
+    unique_ptr<RunStats> stats = nullptr;
+    vector<Trigger> triggers = {};
+    unique_ptr<TraceMarker> trace = nullptr;
+    const CsvColumn *trigger_column = nullptr;
+    const CsvColumn *recv_time_column = nullptr; // Created by the first KEY@NS=value line
+    unique_ptr<CaptureWriter> capture = nullptr;
+    unique_ptr<StdoutLog> stdout_log = nullptr;
+    bool parse_stdout = true; // Whether COMMAND stdout must be read (not only logged)
+    vector<double> tick_values = {}; // Sensor values followed by CPU loads
+    unique_ptr<SharedCounters> counters = nullptr;
+    string counter_lines = {}; // Sampled counters as NAME=value lines
     pid_t child = 0;
+    unsigned running = 0; // Number of COMMAND and --corun processes not yet exited
 } state;
 
 ev_timer measure_timer;
 ev_timer terminate_timer;
-ev_signal sigint_watcher, sigterm_watcher;
+ev_signal sigint_watcher, sigterm_watcher, sigusr1_watcher;
 
 void verbose_ensure_eol()
 {
@@ -365,6 +665,8 @@ static void read_sensor_paths(char *sensors_file)
             continue;
         if (line[0] == '!') {
             state.execs.emplace_back(new Exec(line + 1));
+        } else if (line[0] == '~') {
+            state.sockets.emplace_back(new SocketSource(line + 1));
         } else {
             state.sensors.push_back(sensor(line));
         }
@@ -403,6 +705,8 @@ void set_fan(char *fan_cmd, float speed)
 {
     char *cmd;
     CHECK(asprintf(&cmd, "%s %g", fan_cmd, speed));
+    if (state.trace)
+        state.trace->write("fan %g", speed);
     if (system(cmd) == -1)
         err(1, "Error while executing shell command: %s\n", cmd);
     free(cmd);
@@ -484,21 +788,123 @@ void set_process_affinity(int pid, int cpu_id)
     sched_setaffinity(pid, sizeof(cpu_set_t), &my_set);
 }
 
-StdoutKeyColumn *get_stdout_key_column(const string_view key, vector<StdoutKeyColumn> &stdoutColumns)
+// Parse a CPU list such as "0-3,6" (as in taskset -c)
+static cpu_set_t parse_cpu_list(const string &list, const char *opt)
 {
-    for (unsigned i = 0; i < stdoutColumns.size(); ++i) {
-        if (stdoutColumns[i].key == key)
-            return &(stdoutColumns[i]);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    vector<string> ranges = split(list, ",");
+    if (ranges.empty())
+        errx(1, "%s: Empty CPU list", opt);
+    for (const string &range : ranges) {
+        char *end;
+        unsigned long first = strtoul(range.c_str(), &end, 10), last = first;
+        if (*end == '-')
+            last = strtoul(end + 1, &end, 10);
+        if (!isdigit(range[0]) || *end != '\0' || last < first || last >= CPU_SETSIZE)
+            errx(1, "%s: Invalid CPU list: %s", opt, list.c_str());
+        for (unsigned long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, &set);
     }
-    return nullptr;
+    return set;
+}
+
+StdoutKeyColumn *get_stdout_key_column(const string_view key, vector<StdoutKeyColumn> &stdoutColumns,
+                                       const KeyIndex &index)
+{
+    unsigned pos = index.find(key);
+    return pos == KeyIndex::npos ? nullptr : &(stdoutColumns[pos]);
 }
 
-const CsvColumn *get_stdout_column(const string_view key, vector<StdoutKeyColumn> &stdoutColumns)
+const CsvColumn *get_stdout_column(const string_view key, vector<StdoutKeyColumn> &stdoutColumns,
+                                   const KeyIndex &index)
 {
-    const StdoutKeyColumn *c = get_stdout_key_column(key, stdoutColumns);
+    const StdoutKeyColumn *c = get_stdout_key_column(key, stdoutColumns, index);
     return c ? &(c->column) : nullptr;
 }
 
+static string publisher_header()
+{
+    CsvRow header(columns);
+    columns.setHeader(header);
+    return "# " + state.header_comment + "\n" + header.toString();
+}
+
+// Tell publisher clients about a column created after the start. CSV
+// outputs do it themselves (see CsvOutput).
+static void announce_column(const CsvColumn &col)
+{
+    if (!state.publisher)
+        return;
+    state.publisher->setHeader(publisher_header());
+    state.publisher->publish("# column " + to_string(col.getOrder()) + ": " + csvEscape(col.getHeader()) + "\n");
+}
+
+// Return the column for KEY of COMMAND stdout or of a shared-memory
+// counter. Keys matching a --column pattern get a new column when
+// they appear for the first time.
+static StdoutKeyColumn *find_stdout_key(string_view key)
+{
+    StdoutKeyColumn *col = get_stdout_key_column(key, state.stdoutColumns, state.stdoutIndex);
+    if (col || state.stdoutPatterns.empty() || key.empty() || state.stdoutUnmatched.find(key) != KeyIndex::npos)
+        return col;
+
+    const string k(key);
+    for (const KeyPattern &p : state.stdoutPatterns) {
+        if (fnmatch(p.pattern.c_str(), k.c_str(), 0) == 0) {
+            state.stdoutColumns.push_back(key_column(k + p.func, true, false));
+            state.stdoutIndex.insert(k, state.stdoutColumns.size() - 1);
+            announce_column(state.stdoutColumns.back().column);
+            return &state.stdoutColumns.back();
+        }
+    }
+    // Bound the memory used by programs printing arbitrary keys
+    if (state.stdoutUnmatched.size() < MAX_UNMATCHED_KEYS)
+        state.stdoutUnmatched.insert(k, 0);
+    return nullptr;
+}
+
+// Split the optional "@NS" suffix off the key of a KEY@NS=value line
+// and return NS (CLOCK_MONOTONIC nanoseconds, e.g. from the
+// benchmark) as the run time in ms. Return NaN if there is no
+// timestamp.
+static double key_timestamp(string_view &key)
+{
+    size_t at = key.rfind('@');
+    if (at == string_view::npos)
+        return NAN;
+    const char *first = key.data() + at + 1, *last = key.data() + key.size();
+    uint64_t ns;
+    auto r = from_chars(first, last, ns);
+    if (r.ec != errc() || r.ptr != last)
+        return NAN;
+    key.remove_suffix(key.size() - at);
+
+    uint64_t start_ns = state.start_time.tv_sec * 1000000000ULL + state.start_time.tv_nsec;
+    return (int64_t)(ns - start_ns) / 1e6;
+}
+
+// Column with the time when the timestamped rows were received, which
+// helps to diagnose the delays of the pipe and the event loop
+static const CsvColumn &recv_time_column()
+{
+    if (!state.recv_time_column) {
+        state.recv_time_column = &columns.add("recv_time/ms");
+        announce_column(*state.recv_time_column);
+    }
+    return *state.recv_time_column;
+}
+
+// Warn (once per column) about a KEY value that starts like a number
+// but continues with other characters. Such values are stored as text.
+static void check_value(StdoutKeyColumn &key, CsvCell::Type type, string_view value)
+{
+    if (type != CsvCell::MALFORMED || key.key.empty() || key.malformed++ > 0)
+        return;
+    verbose_ensure_eol();
+    warnx("Malformed number in column %s: %.*s", key.column.getHeader().c_str(), (int)value.size(), value.data());
+}
+
 static double get_current_time()
 {
     struct timespec curr_t;
@@ -507,13 +913,225 @@ static double get_current_time()
     return 1000 * (curr_t.tv_sec - state.start_time.tv_sec + (curr_t.tv_nsec - state.start_time.tv_nsec) * 1e-9);
 }
 
-buffer_t child_stdout_buf;
+// Send the row to all configured outputs
+static void output_row(const CsvRow &row)
+{
+    if (state.aggregator)
+        state.aggregator->add(row, *state.window_out);
+    if (state.out)
+        state.out->write(row);
+}
+
+static void output_comment(const string &comment)
+{
+    if (state.out)
+        state.out->writeComment(comment);
+    if (state.window_out)
+        state.window_out->writeComment(comment);
+}
+
+static void dump_recorder(const string &reason)
+{
+    if (!state.recorder->triggered()) {
+        output_comment("Flight recorder triggered by " + reason);
+        if (verbose) {
+            verbose_ensure_eol();
+            fprintf(stderr, "Flight recorder triggered by %s\n", reason.c_str());
+        }
+    }
+    state.recorder->trigger(output_row);
+}
+
+// Send SIGTERM to COMMAND and --corun commands that are still
+// running. Return whether there was any.
+static bool kill_benchmarks()
+{
+    bool killed = false;
+    if (state.child != 0) {
+        kill(-state.child, SIGTERM);
+        state.child = 0;
+        killed = true;
+    }
+    for (const auto &c : state.coruns)
+        killed |= c->kill();
+    return killed;
+}
+
+static void terminate_child()
+{
+    if (kill_benchmarks()) {
+        verbose_ensure_eol();
+        fprintf(stderr, "Waiting for child to terminate...\n");
+    }
+}
+
+// Report an error in a fork()ed child and terminate it. Unlike exit()
+// (called by err() and CHECK), _exit() does not flush stdio buffers
+// inherited from the parent, which would duplicate its CSV output.
+static void __attribute__((noreturn)) child_fail(const char *what)
+{
+    warn("%s", what);
+    _exit(127);
+}
+
+static void exec_async(const string &cmd)
+{
+    pid_t pid = CHECK(fork());
+    if (pid == 0) {
+        // Child
+        setpgid(0, 0);
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd == -1 || dup2(null_fd, STDIN_FILENO) == -1)
+            child_fail("/dev/null");
+        if (dup2(STDERR_FILENO, STDOUT_FILENO) == -1) // Do not mix with CSV output
+            child_fail("dup2");
+        execl("/bin/sh", "/bin/sh", "-c", cmd.c_str(), NULL);
+        child_fail("exec(/bin/sh)");
+    }
+    // The child is reaped by libev's SIGCHLD handler
+}
+
+static void write_row(const CsvRow &row);
+
+static void run_triggers(const CsvRow &row)
+{
+    for (Trigger &t : state.triggers) {
+        // Rows without the value do not change the trigger state
+        if (row.getValue(t.condition.column.getOrder()).empty())
+            continue;
+        bool holds = t.condition.eval(row);
+        bool fire = holds && !t.holds;
+        t.holds = holds;
+        if (!fire)
+            continue;
+        // Offline replay must not control the fan or start processes
+        if (replay_file && t.action != Trigger::MARK)
+            continue;
+
+        if (verbose || t.action == Trigger::ABORT) {
+            verbose_ensure_eol();
+            fprintf(stderr, "Trigger %s fired\n", t.condition.spec.c_str());
+        }
+        if (state.trace)
+            state.trace->write("trigger %s", t.condition.spec.c_str());
+        switch (t.action) {
+        case Trigger::ABORT:
+            terminate_child();
+            break;
+        case Trigger::FAN:
+            set_fan(fan_cmd, atof(t.arg.c_str()));
+            break;
+        case Trigger::MARK: {
+            CsvRow mark(columns);
+            mark.set(time_column, row.getNumber(time_column.getOrder()));
+            mark.set(*state.trigger_column, t.arg);
+            write_row(mark);
+            break;
+        }
+        case Trigger::EXEC:
+            exec_async(t.arg);
+            break;
+        }
+    }
+}
+
+// Write a short trace record with the time and the filled cells of
+// the row as ORDER=value, where ORDER is the 0-based CSV column index
+static void trace_row(const CsvRow &row)
+{
+    static string rec; // Reused to avoid allocation for every row
+    unsigned time_order = time_column.getOrder();
+    rec.assign(row.getValue(time_order));
+    for (unsigned order : row.getFilled()) {
+        if (order == time_order)
+            continue;
+        char num[16];
+        rec.append(" ").append(num, to_chars(num, num + sizeof(num), order).ptr).append("=");
+        rec.append(row.getValue(order));
+    }
+    state.trace->write("row %s", rec.c_str());
+}
+
+static void write_row(const CsvRow &row)
+{
+    if (state.trace)
+        trace_row(row);
+    if (state.publisher && state.publisher->hasClients())
+        state.publisher->publish(row.toString());
+    if (state.metrics)
+        state.metrics->update(row);
+    if (state.rates)
+        state.rates->add(row);
+    if (state.stats)
+        state.stats->add(row);
+
+    if (!state.recorder) {
+        output_row(row);
+    } else {
+        state.recorder->add(row, output_row);
+        for (const Condition &c : state.dump_conditions) {
+            if (c.eval(row)) {
+                dump_recorder(c.spec);
+                break;
+            }
+        }
+    }
+
+    if (!state.triggers.empty())
+        run_triggers(row);
+}
+
+static void flush_output()
+{
+    if (state.out)
+        state.out->flush();
+    if (state.window_out)
+        state.window_out->flush();
+    if (state.capture)
+        state.capture->flush();
+    if (state.stdout_log)
+        state.stdout_log->flush();
+}
+
+// Prepare row for storing a value of column received at curr_time
+// with optional timestamp time. The row is written first if its time
+// differs or if it already has the value.
+static void start_key_row(CsvRow &row, double &row_time, const CsvColumn &column, double time, double curr_time)
+{
+    double t = isnan(time) ? curr_time : time;
+    if (!row.empty() && (!merge_rows || t != row_time || !row.getValue(column).empty())) {
+        write_row(row);
+        row.clear();
+    }
+    if (row.empty()) {
+        row.set(time_column, t);
+        row_time = t;
+        if (!isnan(time))
+            row.set(recv_time_column(), curr_time);
+    }
+}
+
+LineBuffer child_stdout_buf(MAX_LINE_LENGTH);
+
+static void process_stdout(LineBuffer &buf, const string &prefix, double curr_time);
 
 static void child_stdout_cb(ev::io &w, int revents)
 {
-    buffer_t &buf = child_stdout_buf;
+    LineBuffer &buf = child_stdout_buf;
+    StdoutLog *log = state.stdout_log.get();
+
+    if (log && !state.parse_stdout) {
+        // Nothing to parse - the data need not enter user space
+        if (log->move(w.fd, get_current_time()) == 0)
+            w.stop();
+        return;
+    }
 
-    int ret = ::read(w.fd, buf.data() + buf.size(), buf.capacity() - buf.size());
+    char *data = buf.space();
+    size_t len = log ? log->tee(w.fd, buf.available(), get_current_time()) : buf.available();
+    if (len == 0)
+        return;
+    int ret = ::read(w.fd, data, len);
     if (ret == -1)
         err(1, "child read error");
     else if (ret == 0) {
@@ -522,42 +1140,71 @@ static void child_stdout_cb(ev::io &w, int revents)
         w.stop();
         return;
     }
-    buf.resize(buf.size() + ret);
+    buf.commit(ret);
+    if (log)
+        log->consumed(ret);
 
-    CsvRow row(columns);
     double curr_time = get_current_time();
-    buffer_t::iterator eol;
-    while ((eol = find(buf.begin(), buf.end(), '\n')) != buf.end()) {
-        buffer_t::iterator eq = find(buf.begin(), eol, '=');
-        const CsvColumn *col = nullptr;
-        if (eq != eol) {
-            const string_view key(&(*buf.begin()), distance(buf.begin(), eq));
-            col = get_stdout_column(key, state.stdoutColumns);
+    if (state.capture)
+        state.capture->write(CaptureRecord::STDOUT, 0, curr_time, data, ret);
+    process_stdout(buf, "", curr_time);
+}
+
+// Process complete lines in buf. Keys of --corun commands are
+// prefixed with their PREFIX_ and so are their --stdout lines.
+static void process_stdout(LineBuffer &buf, const string &prefix, double curr_time)
+{
+    static string prefixed; // Reused to avoid allocation for every line
+    unsigned long truncated = buf.truncated();
+    CsvRow row(columns);
+    double row_time = NAN;
+    string_view line;
+    while (buf.next(line)) {
+        size_t eq = line.find('=');
+        StdoutKeyColumn *key = nullptr;
+        double time = NAN;
+        if (eq != string_view::npos) {
+            string_view name = line.substr(0, eq);
+            time = key_timestamp(name);
+            if (prefix.empty()) {
+                key = find_stdout_key(name);
+            } else {
+                prefixed.assign(prefix).append("_").append(name);
+                key = find_stdout_key(prefixed);
+            }
         }
-        if (col) {
-            if (row.empty())
-                row.set(time_column, curr_time);
-            if (!row.getValue(*col).empty()) {
-                row.write(state.out_fp);
+        if (key && key->aggregated) {
+            check_value(*key, key->acc.addUnescaped(line.substr(eq + 1)), line.substr(eq + 1));
+        } else if (key) {
+            start_key_row(row, row_time, key->column, time, curr_time);
+            row.set(key->column, line.substr(eq + 1));
+            check_value(*key, row.getCell(key->column.getOrder()).type, line.substr(eq + 1));
+        } else if (write_stdout) {
+            if (!row.empty() && row_time != curr_time) {
+                write_row(row);
                 row.clear();
-                row.set(time_column, curr_time);
             }
-            const string_view value(&(*(eq + 1)), distance(eq + 1, eol));
-            row.set(*col, string(value));
-        } else if (write_stdout) {
-            string line(&(*buf.begin()), distance(buf.begin(), eol));
             row.set(time_column, curr_time);
-            row.set(*stdout_column, line);
-            row.write(state.out_fp);
+            if (prefix.empty()) {
+                row.set(*stdout_column, line);
+            } else {
+                prefixed.assign(prefix).append(": ").append(line);
+                row.set(*stdout_column, prefixed);
+            }
+            write_row(row);
             row.clear();
         }
-        buf.erase(buf.begin(), eol + 1);
+    }
+
+    if (truncated == 0 && buf.truncated() > 0) {
+        verbose_ensure_eol();
+        warnx("COMMAND output line longer than %d bytes truncated", MAX_LINE_LENGTH);
     }
 
     if (!row.empty())
-        row.write(state.out_fp);
+        write_row(row);
     if (csv_unbuffered)
-        fflush(state.out_fp);
+        flush_output();
 }
 
 void Exec::start(ev::loop_ref loop)
@@ -586,8 +1233,6 @@ void Exec::start(ev::loop_ref loop)
     child_stdout.set(loop);
     child_stdout.set<Exec, &Exec::child_stdout_cb>(this);
     child_stdout.start(pipefds[0], ev::READ);
-
-    buf.reset(new __gnu_cxx::stdio_filebuf<char>(pipefds[0], ios::in));
 }
 
 void Exec::kill()
@@ -597,52 +1242,107 @@ void Exec::kill()
     }
 }
 
-void Exec::child_stdout_cb(ev::io &w, int revents)
+// Store a line received from --exec or --socket to the column
+// selected by its KEY= prefix (or to the catch_all column). Values of
+// synchronous columns are only remembered, others are stored to row,
+// which is written first if it already has a value in the column.
+static void store_key_line(string_view line, vector<StdoutKeyColumn> &keys, const KeyIndex &index,
+                           StdoutKeyColumn *catch_all, CsvRow &row, double &row_time, double curr_time)
 {
-    istream pipe_in(buf.get());
-    string line;
-    double curr_time = get_current_time();
-    CsvRow row(::columns);
-    while (getline(pipe_in, line)) {
-        line.erase(line.find_last_not_of("\r\n") + 1);
-        size_t index = line.find_first_of('=');
-        StdoutKeyColumn *column = nullptr;
-
-        if (index != string::npos)
-            column = get_stdout_key_column((line.substr(0, index)).c_str(), this->columns);
-
-        if (column)
-            line = line.substr(index + 1);
-        else
-            column = this->stdout_col;
+    size_t eq = line.find('=');
+    StdoutKeyColumn *column = nullptr;
+    double time = NAN;
+
+    if (eq != string_view::npos) {
+        string_view name = line.substr(0, eq);
+        time = key_timestamp(name);
+        column = get_stdout_key_column(name, keys, index);
+    }
 
-        if (column) {
-            if (column->synchronous) {
-                column->last_value = move(line);
-            } else {
-                if (row.empty())
-                    row.set(time_column, curr_time);
+    if (column)
+        line.remove_prefix(eq + 1);
+    else
+        column = catch_all;
 
-                if (!row.getValue(column->column).empty()) {
-                    row.write(state.out_fp);
-                    row.clear();
-                    row.set(time_column, curr_time);
-                }
-                row.set(column->column, line.c_str());
-            }
+    if (column) {
+        if (column->aggregated) {
+            check_value(*column, column->acc.addUnescaped(line), line);
+        } else if (column->synchronous) {
+            column->last_value = line;
+        } else {
+            start_key_row(row, row_time, column->column, time, curr_time);
+            row.set(column->column, line);
+            check_value(*column, row.getCell(column->column.getOrder()).type, line);
         }
     }
+}
+
+// Store all complete lines from buf (see store_key_line)
+static void store_key_lines(LineBuffer &buf, vector<StdoutKeyColumn> &keys, const KeyIndex &index,
+                            StdoutKeyColumn *catch_all, double curr_time)
+{
+    CsvRow row(columns);
+    double row_time = NAN;
+    string_view line;
+    while (buf.next(line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        store_key_line(line, keys, index, catch_all, row, row_time, curr_time);
+    }
 
     if (!row.empty())
-        row.write(state.out_fp);
+        write_row(row);
 
     if (csv_unbuffered)
-        fflush(state.out_fp);
+        flush_output();
+}
 
-    // Stop the watcher if the pipe is closed. If this was the last
-    // watcher, the event loop terminates.
-    if (pipe_in.eof())
+// Store remembered values of synchronous columns to the row
+static void store_sync_columns(vector<StdoutKeyColumn> &keys, CsvRow &row)
+{
+    for (auto &c : keys) {
+        if (c.aggregated) {
+            c.acc.set(row, c.column, c.func);
+            c.acc.reset();
+        } else if (c.synchronous) {
+            row.set(c.column, move(c.last_value));
+            c.last_value.erase();
+        }
+    }
+}
+
+void Exec::child_stdout_cb(ev::io &w, int revents)
+{
+    char *data = lines.space();
+    ssize_t len = read(w.fd, data, lines.available());
+    if (len == -1 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (len == -1)
+        err(1, "read(%s)", cmd.c_str());
+
+    double curr_time = get_current_time();
+    if (len == 0) {
+        // Stop the watcher if the pipe is closed. If this was the
+        // last watcher, the event loop terminates.
         w.stop();
+        close(w.fd);
+        lines.terminate();
+    } else {
+        lines.commit(len);
+        if (state.capture)
+            state.capture->write(CaptureRecord::EXEC, index, curr_time, data, len);
+    }
+    store_key_lines(lines, this->columns, key_index, this->stdout_col, curr_time);
+}
+
+void Exec::process(const char *data, size_t len, double curr_time)
+{
+    while (len > 0) {
+        size_t n = lines.append(data, len);
+        data += n;
+        len -= n;
+        store_key_lines(lines, this->columns, key_index, this->stdout_col, curr_time);
+    }
 }
 
 void Exec::child_exit_cb(ev::child &w, int revents)
@@ -654,66 +1354,396 @@ void Exec::child_exit_cb(ev::child &w, int revents)
     pid = 0;
 }
 
-static void child_exit_cb(EV_P_ ev_child *w, int revents)
-{
-    // Stop all child-related watchers. If no watches remain started,
-    // the event loop exits.
-    ev_child_stop(EV_A_ w);
-
-    // Stop other watchers that my block event loop from exiting.
-    ev_timer_stop(EV_A_ & measure_timer);
-    ev_timer_stop(EV_A_ & terminate_timer);
-    ev_signal_stop(EV_A_ & sigint_watcher);
-    ev_signal_stop(EV_A_ & sigterm_watcher);
-
-    // Also kill other processes - if there are any, event loop exits
-    // after all terminate.
-    for (const auto &exec : state.execs)
-        exec->kill();
+static void benchmark_exited();
 
-    // Now, we wait for children stdout pipes to be closed. After all
-    // are closed, our event loop exits.
+const string Corun::parse_prefix(const string &arg)
+{
+    size_t end = arg.find_first_of("@)");
+    if (arg[0] != '(' || end == string::npos || arg.find(')') == string::npos)
+        errx(1, "--corun: Missing (PREFIX) in %s", arg.c_str());
+    string prefix = arg.substr(1, end - 1);
+    // PREFIX_KEY columns should be usable in --derive expressions
+    if (prefix.empty() || !all_of(prefix.begin(), prefix.end(), [](unsigned char c) { return isalnum(c) || c == '_'; }))
+        errx(1, "--corun: Invalid PREFIX: %s", prefix.c_str());
+    return prefix;
 }
 
-static void measure_timer_cb(EV_P_ ev_timer *w, int revents)
+Corun::Corun(const string &arg)
+    : Corun(parse_prefix(arg), arg.substr(arg.find(')') + 1))
 {
-    CsvRow row(columns);
-    auto time = get_current_time();
+    if (cmd.find_first_not_of(" \t\r\n") == string::npos)
+        errx(1, "--corun: No command");
+    size_t at = arg.find('@'), end = arg.find(')');
+    if (at < end) {
+        cpus = parse_cpu_list(arg.substr(at + 1, end - at - 1), "--corun");
+        has_affinity = true;
+    }
+}
+
+void Corun::start(ev::loop_ref loop)
+{
+    int pipefds[2];
+
+    CHECK(pipe2(pipefds, O_NONBLOCK));
+
+    pid = CHECK(fork());
+
+    if (pid == 0) {
+        // Child
+        setpgid(0, 0); // Own process group to be killed with its children
+        close(pipefds[0]);
+        // Counters in the --counters region are stored without PREFIX_
+        unsetenv(TB_COUNTERS_ENV);
+        if (has_affinity && sched_setaffinity(0, sizeof(cpus), &cpus) == -1)
+            child_fail(("--corun: sched_setaffinity(" + prefix + ")").c_str());
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd == -1 || dup2(null_fd, STDIN_FILENO) == -1)
+            child_fail("/dev/null");
+        if (dup2(pipefds[1], STDOUT_FILENO) == -1)
+            child_fail("dup2");
+        execl("/bin/sh", "/bin/sh", "-c", cmd.c_str(), NULL);
+        child_fail("exec(/bin/sh)");
+    }
+
+    close(pipefds[1]);
+    state.running++;
+    if (state.trace)
+        state.trace->write("start %s pid=%d", prefix.c_str(), pid);
+
+    child.set(loop);
+    child.set<Corun, &Corun::child_exit_cb>(this);
+    child.start(pid);
+
+    child_stdout.set(loop);
+    child_stdout.set<Corun, &Corun::child_stdout_cb>(this);
+    child_stdout.start(pipefds[0], ev::READ);
+}
+
+bool Corun::kill()
+{
+    if (pid <= 0)
+        return false;
+    ::kill(-pid, SIGTERM);
+    pid = 0;
+    return true;
+}
+
+void Corun::child_stdout_cb(ev::io &w, int revents)
+{
+    char *data = lines.space();
+    ssize_t len = read(w.fd, data, lines.available());
+    if (len == -1 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (len == -1)
+        err(1, "read(%s)", cmd.c_str());
+
+    double curr_time = get_current_time();
+    if (len == 0) {
+        w.stop();
+        close(w.fd);
+        lines.terminate();
+    } else {
+        lines.commit(len);
+        if (state.capture)
+            state.capture->write(CaptureRecord::STDOUT, index, curr_time, data, len);
+    }
+    process_stdout(lines, prefix, curr_time);
+}
+
+void Corun::process(const char *data, size_t len, double curr_time)
+{
+    while (len > 0) {
+        size_t n = lines.append(data, len);
+        data += n;
+        len -= n;
+        process_stdout(lines, prefix, curr_time);
+    }
+}
+
+void Corun::child_exit_cb(ev::child &w, int revents)
+{
+    int s = w.rstatus;
+    w.stop();
+    if (state.trace)
+        state.trace->write("exit %s status=%d", prefix.c_str(), s);
+    // As for COMMAND, pid is zero if we killed it ourselves
+    if (state.recorder && pid != 0 && (WIFSIGNALED(s) || WEXITSTATUS(s) != 0))
+        dump_recorder("abnormal " + prefix + " exit");
+    pid = 0;
+
+    benchmark_exited();
+}
+
+// SPEC is SENSOR:PERIOD[:FILTER]
+Oversampler *Oversampler::parse(const string &spec)
+{
+    vector<string> parts = split(spec, ":");
+    if (parts.size() < 2 || parts.size() > 3)
+        errx(1, "Invalid --oversample specification: %s", spec.c_str());
+
+    unsigned idx;
+    for (idx = 0; idx < state.sensors.size(); idx++)
+        if (state.sensors[idx].name == parts[0])
+            break;
+    if (idx == state.sensors.size())
+        errx(1, "--oversample: Unknown sensor: %s", parts[0].c_str());
+
+    char *end;
+    double period_ms = strtod(parts[1].c_str(), &end);
+    if (end == parts[1].c_str() || *end != '\0' || period_ms <= 0)
+        errx(1, "--oversample: Invalid period: %s", parts[1].c_str());
+
+    return new Oversampler(idx, period_ms, Filter::parse(parts.size() > 2 ? parts[2] : "mean"));
+}
+
+void Oversampler::start(ev::loop_ref loop)
+{
+    timer.set(loop);
+    timer.set<Oversampler, &Oversampler::timer_cb>(this);
+    timer.start(0, period_ms / 1000.0);
+}
+
+void Oversampler::timer_cb(ev::timer &w, int revents)
+{
+    filter.add(read_sensor(state.sensors[sensor_idx].path.c_str()), get_current_time());
+}
+
+// Return the filtered value or read the sensor directly if no samples
+// are available
+double Oversampler::output()
+{
+    double value = filter.output();
+    return isnan(value) ? read_sensor(state.sensors[sensor_idx].path.c_str()) : value;
+}
+
+void SocketSource::start(ev::loop_ref loop)
+{
+    io.set(loop);
+    reconnect_timer.set(loop);
+    reconnect_timer.set<SocketSource, &SocketSource::reconnect_cb>(this);
+    connect();
+}
+
+void SocketSource::stop()
+{
+    reconnect_timer.stop();
+    if (io.is_active())
+        disconnect();
+}
+
+void SocketSource::connect()
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        errx(1, "Socket path too long: %s", path.c_str());
+    memcpy(addr.sun_path, path.data(), path.size());
+    if (path[0] == '@')
+        addr.sun_path[0] = '\0'; // Abstract socket
+    socklen_t len = offsetof(struct sockaddr_un, sun_path) + path.size() + (path[0] == '@' ? 0 : 1);
+
+    // Never block the event loop, e.g. when the server's backlog is full
+    int fd = CHECK(socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if (::connect(fd, (struct sockaddr *)&addr, len) == 0) {
+        connected(fd);
+    } else if (errno == EINPROGRESS) {
+        io.set<SocketSource, &SocketSource::connect_cb>(this);
+        io.start(fd, ev::WRITE);
+    } else {
+        // EAGAIN (full backlog of a Unix socket) is not retried by
+        // the kernel - retry later as other errors
+        connect_failed(fd, errno);
+    }
+}
+
+void SocketSource::connect_cb(ev::io &w, int revents)
+{
+    int error = 0;
+    socklen_t len = sizeof(error);
+    io.stop();
+    if (getsockopt(w.fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+        error = errno;
+    if (error)
+        connect_failed(w.fd, error);
+    else
+        connected(w.fd);
+}
+
+void SocketSource::connected(int fd)
+{
+    report_errors = true;
+    io.set<SocketSource, &SocketSource::read_cb>(this);
+    io.start(fd, ev::READ);
+}
+
+void SocketSource::connect_failed(int fd, int error)
+{
+    if (report_errors) {
+        verbose_ensure_eol();
+        warnx("connect(%s): %s", path.c_str(), strerror(error));
+        report_errors = false;
+    }
+    close(fd);
+    reconnect_timer.start(reconnect_delay);
+}
+
+void SocketSource::disconnect()
+{
+    io.stop();
+    close(io.fd);
+    lines.clear();
+}
+
+void SocketSource::reconnect_cb(ev::timer &w, int revents)
+{
+    connect();
+}
+
+void SocketSource::read_cb(ev::io &w, int revents)
+{
+    char *data = lines.space();
+    ssize_t len = read(w.fd, data, lines.available());
+    if (len == -1 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (len <= 0) {
+        verbose_ensure_eol();
+        if (len == -1)
+            warn("read(%s)", path.c_str());
+        else
+            warnx("%s: Connection closed, reconnecting", path.c_str());
+        disconnect();
+        reconnect_timer.start(reconnect_delay);
+        return;
+    }
+
+    double curr_time = get_current_time();
+    if (state.capture)
+        state.capture->write(CaptureRecord::SOCKET, index, curr_time, data, len);
+    lines.commit(len);
+    store_key_lines(lines, columns, key_index, catch_all, curr_time);
+}
+
+void SocketSource::process(const char *data, size_t len, double curr_time)
+{
+    while (len > 0) {
+        size_t n = lines.append(data, len);
+        data += n;
+        len -= n;
+        store_key_lines(lines, columns, key_index, catch_all, curr_time);
+    }
+}
+
+static void child_exit_cb(EV_P_ ev_child *w, int revents)
+{
+    ev_child_stop(EV_A_ w);
+
+    int s = w->rstatus;
+    if (state.trace)
+        state.trace->write("exit status=%d", s);
+
+    // When we did not terminate the COMMAND ourselves (state.child is
+    // zero then), non-zero exit status is a reason for dumping the
+    // flight recorder.
+    if (state.recorder && state.child != 0 && (WIFSIGNALED(s) || WEXITSTATUS(s) != 0))
+        dump_recorder("abnormal COMMAND exit");
+    state.child = 0;
+
+    benchmark_exited();
+}
+
+// Called when COMMAND or a --corun command exits. Unless --wait-all
+// is given, the first exit terminates the others. After the last
+// one, stop all watchers that may block the event loop from exiting.
+static void benchmark_exited()
+{
+    if (--state.running > 0) {
+        if (!wait_all)
+            kill_benchmarks();
+        return;
+    }
+
+    ev_timer_stop(EV_DEFAULT_ & measure_timer);
+    ev_timer_stop(EV_DEFAULT_ & terminate_timer);
+    ev_signal_stop(EV_DEFAULT_ & sigint_watcher);
+    ev_signal_stop(EV_DEFAULT_ & sigterm_watcher);
+    ev_signal_stop(EV_DEFAULT_ & sigusr1_watcher);
+    if (state.publisher)
+        state.publisher->stop();
+    if (state.metrics)
+        state.metrics->stop();
+
+    // Also kill other processes - if there are any, event loop exits
+    // after all terminate.
+    for (const auto &exec : state.execs)
+        exec->kill();
+    for (const auto &sock : state.sockets)
+        sock->stop();
+    for (const auto &o : state.oversamplers)
+        o->timer.stop();
+
+    // Now, we wait for children stdout pipes to be closed. After all
+    // are closed, our event loop exits.
+}
+
+// Write the periodic row with sensor values and CPU loads given by
+// values (in the order of state.sensors and cpus) and shared-memory
+// counters given as NAME=value lines
+static void measure_row(double time, const vector<double> &values, string_view counters)
+{
+    CsvRow row(columns);
     double temp = NAN;
     row.set(time_column, time);
 
+    for (size_t start = 0, end; (end = counters.find('\n', start)) != string_view::npos; start = end + 1) {
+        string_view line = counters.substr(start, end - start);
+        size_t eq = line.find('=');
+        if (eq == string_view::npos)
+            continue;
+        StdoutKeyColumn *key = find_stdout_key(line.substr(0, eq));
+        if (key && key->aggregated)
+            key->acc.addUnescaped(line.substr(eq + 1));
+        else if (key)
+            row.set(key->column, line.substr(eq + 1));
+    }
+
     // Save sensor values
     for (unsigned i = 0; i < state.sensors.size(); ++i) {
-        double t = read_sensor(state.sensors[i].path.c_str());
+        double t = values[i];
         if (isnan(temp))
             temp = t;
         row.set(state.sensors[i].column, t);
     }
 
-    // Save last values of synchronous exec columns
-    for (auto &e : state.execs) {
-        if (!e->has_sync_column)
-            continue;
-        for (auto &c : e->columns) {
-            if (!c.synchronous)
-                continue;
-            row.set(c.column, move(c.last_value));
-            c.last_value.erase();
-        }
-    }
+    // Save last values of synchronous exec columns and aggregated keys
+    store_sync_columns(state.stdoutColumns, row);
+    for (auto &e : state.execs)
+        if (e->has_sync_column)
+            store_sync_columns(e->columns, row);
+    for (auto &s : state.sockets)
+        if (s->has_sync_column)
+            store_sync_columns(s->columns, row);
 
     // Save CPU usage columns
-    if (calc_cpu_usage) {
-        read_procstat();
-        for (unsigned i = 0; i < n_cpus; ++i) {
-            row.set(cpus[i].column, get_cpu_usage(cpus[i]));
-        }
+    for (unsigned i = 0; i < cpus.size() && state.sensors.size() + i < values.size(); ++i)
+        row.set(cpus[i].column, values[state.sensors.size() + i]);
+
+    if (state.rates) {
+        state.rates->add(row);
+        state.rates->set(row);
+    }
+
+    for (auto &d : state.derived) {
+        double value = d.expr.eval(row);
+        if (!isnan(value))
+            row.setExact(d.column, value);
     }
+    for (auto &d : state.derived)
+        d.expr.update(row);
 
-    row.write(state.out_fp);
+    write_row(row);
 
     if (csv_unbuffered)
-        fflush(state.out_fp);
+        flush_output();
 
     if (verbose) {
         fprintf(stderr, "\r%.1fs  %.1f°C   ", time / 1000.0, temp / 1000.0);
@@ -721,14 +1751,38 @@ static void measure_timer_cb(EV_P_ ev_timer *w, int revents)
     }
 }
 
-static void terminate_timer_cb(EV_P_ ev_timer *w, int revents)
+static void measure_timer_cb(EV_P_ ev_timer *w, int revents)
 {
-    if (state.child != 0) {
-        verbose_ensure_eol();
-        fprintf(stderr, "Waiting for child to terminate...\n");
-        kill(-state.child, SIGTERM);
-        state.child = 0;
+    auto time = get_current_time();
+    vector<double> &values = state.tick_values;
+    values.clear();
+
+    for (const sensor &s : state.sensors)
+        values.push_back(s.oversampler >= 0 ? state.oversamplers[s.oversampler]->output() : read_sensor(s.path.c_str()));
+
+    if (calc_cpu_usage) {
+        read_procstat();
+        for (unsigned i = 0; i < n_cpus; ++i)
+            values.push_back(get_cpu_usage(cpus[i]));
     }
+
+    string &counters = state.counter_lines;
+    counters.clear();
+    if (state.counters)
+        state.counters->read(counters);
+
+    if (state.capture) {
+        if (!counters.empty())
+            state.capture->write(CaptureRecord::COUNTERS, 0, time, counters);
+        state.capture->write(CaptureRecord::TICK, 0, time, values.data(), values.size() * sizeof(double));
+    }
+
+    measure_row(time, values, counters);
+}
+
+static void terminate_timer_cb(EV_P_ ev_timer *w, int revents)
+{
+    terminate_child();
 }
 
 // Called as a response to SIGINT and SIGTERM
@@ -737,12 +1791,17 @@ static void sigint_cb(struct ev_loop *loop, ev_signal *w, int revents)
     verbose_ensure_eol();
     fprintf(stderr, "Waiting for child to terminate...\n");
 
-    if (state.child != 0) {
-        kill(-state.child, SIGTERM);
-        state.child = 0;
-    }
+    kill_benchmarks();
 
-    // When the child terminates, we get notified via child_exit_cb.
+    // When the children terminate, we get notified via child_exit_cb
+    // and Corun::child_exit_cb.
+}
+
+static void sigusr1_cb(struct ev_loop *loop, ev_signal *w, int revents)
+{
+    dump_recorder("SIGUSR1");
+    if (csv_unbuffered)
+        flush_output();
 }
 
 void measure(int measure_period_ms)
@@ -750,11 +1809,16 @@ void measure(int measure_period_ms)
     int p[2];
     CHECK(pipe(p));
 
+    if (state.counters)
+        setenv(TB_COUNTERS_ENV, state.counters->path().c_str(), 1);
+
     if (verbose) {
         int argc = 0;
         while (benchmark_argv[argc] != NULL)
             argc++;
         fprintf(stderr, "Running: %s\n", shell_quote(argc, benchmark_argv).c_str());
+        for (const auto &c : state.coruns)
+            fprintf(stderr, "Running (%s): %s\n", c->prefix.c_str(), c->cmd.c_str());
     }
 
     pid_t pid = fork();
@@ -769,6 +1833,8 @@ void measure(int measure_period_ms)
         // Run the benchmark in background process group so that we
         // can kill it with its all potential children.
         setpgid(0, 0);
+        if (benchmark_affinity && sched_setaffinity(0, sizeof(benchmark_cpus), &benchmark_cpus) == -1)
+            err(1, "--affinity");
         // Background processes are stopped when they happen to read
         // from a controlling terminal. We don't want the benchmark to
         // be stopped, so we do not run in on terminal. If stdin is
@@ -794,13 +1860,18 @@ void measure(int measure_period_ms)
     // significantly. There are no watchers so no callback is invoked.
     ev_run(loop, EVRUN_NOWAIT);
 
+    if (state.trace)
+        state.trace->write("start pid=%d", pid);
+
     ev_child_init(&child_exit, child_exit_cb, pid, 0);
     ev_child_start(loop, &child_exit);
     state.child = pid;
+    state.running = 1;
 
-    child_stdout_buf.reserve(0x10000);
     CHECK(fcntl(p[0], F_SETFL, CHECK(fcntl(p[0], F_GETFL)) | O_NONBLOCK));
     close(p[1]);
+    state.parse_stdout
+        = !state.stdoutColumns.empty() || !state.stdoutPatterns.empty() || write_stdout || state.capture;
     child_stdout.set<child_stdout_cb>();
     child_stdout.start(p[0], ev::READ);
 
@@ -813,15 +1884,37 @@ void measure(int measure_period_ms)
     ev_signal_start(loop, &sigint_watcher);
     ev_signal_init(&sigterm_watcher, sigint_cb, SIGTERM);
     ev_signal_start(loop, &sigterm_watcher);
+    if (state.recorder) {
+        ev_signal_init(&sigusr1_watcher, sigusr1_cb, SIGUSR1);
+        ev_signal_start(loop, &sigusr1_watcher);
+    }
+
+    if (state.publisher)
+        state.publisher->start(loop, publisher_header());
+
+    if (state.metrics)
+        state.metrics->start(loop);
 
-    bool have_sync_exec = false;
+    bool have_sync_column = false;
     for (const auto &exec : state.execs) {
         exec->start(loop);
-        have_sync_exec |= exec->has_sync_column;
+        have_sync_column |= exec->has_sync_column;
     }
+    for (const auto &sock : state.sockets) {
+        sock->start(loop);
+        have_sync_column |= sock->has_sync_column;
+    }
+    for (const auto &o : state.oversamplers)
+        o->start(loop);
+    for (const auto &c : state.coruns)
+        c->start(loop);
+    for (const auto &c : state.stdoutColumns)
+        have_sync_column |= c.synchronous;
+    for (const auto &p : state.stdoutPatterns)
+        have_sync_column |= !p.func.empty();
 
     ev_timer_init(&measure_timer, measure_timer_cb, 0.0, measure_period_ms / 1000.0);
-    if (state.sensors.size() > 0 || have_sync_exec)
+    if (state.sensors.size() > 0 || have_sync_column || state.rates || state.counters)
         ev_timer_start(loop, &measure_timer);
 
     if (sched_deadline) {
@@ -832,15 +1925,199 @@ void measure(int measure_period_ms)
     }
 
     clock_gettime(CLOCK_MONOTONIC, &state.start_time);
+    if (state.capture)
+        state.capture->write(CaptureRecord::START, 0, 0, &state.start_time, sizeof(state.start_time));
 
     ev_run(loop, 0);
 
     verbose_ensure_eol();
 }
 
+static string sensor_spec(const sensor &s)
+{
+    return s.path + " " + s.name + (s.units.empty() ? "" : " " + s.units);
+}
+
+// Write definitions of all sources to the capture file
+static void capture_definitions(const string &comment)
+{
+    CaptureWriter &c = *state.capture;
+
+    c.write(CaptureRecord::COMMENT, 0, 0, comment);
+    for (unsigned i = 0; i < state.sensors.size(); i++)
+        c.write(CaptureRecord::SENSOR_DEF, i, 0, sensor_spec(state.sensors[i]));
+    for (unsigned i = 0; i < state.execs.size(); i++) {
+        state.execs[i]->index = i;
+        c.write(CaptureRecord::EXEC_DEF, i, 0, state.execs[i]->cmd);
+    }
+    for (unsigned i = 0; i < state.sockets.size(); i++) {
+        state.sockets[i]->index = i;
+        c.write(CaptureRecord::SOCKET_DEF, i, 0, state.sockets[i]->path);
+    }
+    for (unsigned i = 0; i < state.coruns.size(); i++) {
+        state.coruns[i]->index = i + 1;
+        c.write(CaptureRecord::CORUN_DEF, i + 1, 0, state.coruns[i]->prefix);
+    }
+}
+
+static bool is_definition(const CaptureRecord &rec)
+{
+    switch (rec.hdr.type) {
+    case CaptureRecord::COMMENT:
+    case CaptureRecord::SENSOR_DEF:
+    case CaptureRecord::EXEC_DEF:
+    case CaptureRecord::SOCKET_DEF:
+    case CaptureRecord::CORUN_DEF:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Use the sensors of the captured run
+static void add_captured_sensors(const char *file)
+{
+    CaptureReader reader(file);
+    CaptureRecord rec;
+
+    while (reader.next(rec) && is_definition(rec))
+        if (rec.hdr.type == CaptureRecord::SENSOR_DEF)
+            state.sensors.push_back(sensor(rec.data.c_str()));
+}
+
+// Regenerate the output from the inputs recorded by --capture. Time
+// of each record is used instead of the current time.
+static void replay(const char *file)
+{
+    CaptureReader reader(file);
+    CaptureRecord rec;
+    vector<string> captured_sensors; // Paths
+    vector<unsigned> sensor_map; // state.sensors index -> captured index
+    vector<Exec *> exec_map; // Captured index -> Exec
+    vector<SocketSource *> socket_map;
+    vector<Corun *> corun_map;
+    vector<double> captured;
+    string counters;
+
+    while (reader.next(rec)) {
+        const unsigned src = rec.hdr.source;
+        const double time = rec.hdr.time;
+
+        if (!is_definition(rec) && sensor_map.size() != state.sensors.size()) {
+            for (const sensor &s : state.sensors) {
+                auto it = find(captured_sensors.begin(), captured_sensors.end(), s.path);
+                if (it == captured_sensors.end())
+                    errx(1, "--replay: Sensor %s not captured in %s", s.path.c_str(), file);
+                sensor_map.push_back(it - captured_sensors.begin());
+            }
+        }
+
+        switch (rec.hdr.type) {
+        case CaptureRecord::COMMENT:
+            break;
+        case CaptureRecord::SENSOR_DEF:
+            captured_sensors.push_back(split_words(rec.data).at(0));
+            break;
+        case CaptureRecord::EXEC_DEF:
+            exec_map.resize(max<size_t>(exec_map.size(), src + 1));
+            for (const auto &e : state.execs)
+                if (e->cmd == rec.data)
+                    exec_map[src] = e.get();
+            break;
+        case CaptureRecord::SOCKET_DEF:
+            socket_map.resize(max<size_t>(socket_map.size(), src + 1));
+            for (const auto &s : state.sockets)
+                if (s->path == rec.data)
+                    socket_map[src] = s.get();
+            break;
+        case CaptureRecord::CORUN_DEF:
+            // Only the prefix is needed - create the --corun if not given
+            corun_map.resize(max<size_t>(corun_map.size(), src + 1));
+            for (const auto &c : state.coruns)
+                if (c->prefix == rec.data)
+                    corun_map[src] = c.get();
+            if (!corun_map[src]) {
+                state.coruns.emplace_back(new Corun(rec.data, ""));
+                corun_map[src] = state.coruns.back().get();
+            }
+            break;
+        case CaptureRecord::TICK: {
+            captured.resize(rec.data.size() / sizeof(double));
+            memcpy(captured.data(), rec.data.data(), captured.size() * sizeof(double));
+            vector<double> &values = state.tick_values;
+            values.clear();
+            for (unsigned idx : sensor_map)
+                values.push_back(idx < captured.size() ? captured[idx] : NAN);
+            // CPU loads follow the sensor values
+            if (calc_cpu_usage)
+                for (size_t i = captured_sensors.size(); i < captured.size(); i++)
+                    values.push_back(captured[i]);
+            measure_row(time, values, counters);
+            counters.clear();
+            break;
+        }
+        case CaptureRecord::STDOUT:
+            if (src != 0) {
+                if (src < corun_map.size() && corun_map[src])
+                    corun_map[src]->process(rec.data.data(), rec.data.size(), time);
+                break;
+            }
+            for (size_t pos = 0; pos < rec.data.size();) {
+                pos += child_stdout_buf.append(rec.data.data() + pos, rec.data.size() - pos);
+                process_stdout(child_stdout_buf, "", time);
+            }
+            break;
+        case CaptureRecord::EXEC:
+            if (src < exec_map.size() && exec_map[src])
+                exec_map[src]->process(rec.data.data(), rec.data.size(), time);
+            break;
+        case CaptureRecord::SOCKET:
+            if (src < socket_map.size() && socket_map[src])
+                socket_map[src]->process(rec.data.data(), rec.data.size(), time);
+            break;
+        case CaptureRecord::COUNTERS:
+            counters = rec.data;
+            break;
+        case CaptureRecord::START:
+            // Needed for converting KEY@NS timestamps
+            memcpy(&state.start_time, rec.data.data(), min(rec.data.size(), sizeof(state.start_time)));
+            break;
+        default:
+            warnx("%s: Unknown record type %d", file, rec.hdr.type);
+        }
+    }
+}
+
 enum {
     OPT_UNBUFFERED = 1000,
     OPT_SCHED_DEADLINE,
+    OPT_FORMAT,
+    OPT_NO_MERGE,
+    OPT_WINDOW,
+    OPT_WINDOW_OUTPUT,
+    OPT_AGGREGATE,
+    OPT_FLIGHT_RECORDER,
+    OPT_DUMP_ON,
+    OPT_ROTATE_SIZE,
+    OPT_ROTATE_TIME,
+    OPT_PUBLISH,
+    OPT_METRICS,
+    OPT_SOCKET,
+    OPT_OVERSAMPLE,
+    OPT_DERIVE,
+    OPT_RATE,
+    OPT_ENERGY,
+    OPT_STATS,
+    OPT_STATS_FIRST,
+    OPT_TRIGGER,
+    OPT_TRACE_MARKER,
+    OPT_CAPTURE,
+    OPT_REPLAY,
+    OPT_COUNTERS,
+    OPT_STDOUT_LOG,
+    OPT_CORUN,
+    OPT_AFFINITY,
+    OPT_WAIT_ALL,
 };
 
 static error_t parse_opt(int key, char *arg, struct argp_state *argp_state)
@@ -888,9 +2165,18 @@ static error_t parse_opt(int key, char *arg, struct argp_state *argp_state)
     case 'l':
         write_stdout = true;
         break;
-    case 'c':
-        state.stdoutColumns.push_back(StdoutKeyColumn(arg, arg, false));
+    case 'c': {
+        const string spec = arg;
+        const size_t colon = agg_suffix(spec);
+        const string name = spec.substr(0, colon);
+        if (name.find_first_of("*?[") != string::npos) {
+            string func = colon == string::npos ? "" : spec.substr(colon);
+            state.stdoutPatterns.push_back({ name, func });
+        } else {
+            state.stdoutColumns.push_back(key_column(spec, true, false));
+        }
         break;
+    }
     case 't':
         terminate_time = atoi(arg);
         break;
@@ -906,6 +2192,58 @@ static error_t parse_opt(int key, char *arg, struct argp_state *argp_state)
     case 'E':
         exec_wait = true;
         break;
+    case OPT_SOCKET:
+        state.sockets.emplace_back(new SocketSource(arg));
+        break;
+    case OPT_OVERSAMPLE:
+        oversample_specs.push_back(arg);
+        break;
+    case OPT_RATE:
+        rate_specs.push_back(arg);
+        break;
+    case OPT_ENERGY:
+        energy_specs.push_back(arg);
+        break;
+    case OPT_STATS:
+        stats_file = arg;
+        break;
+    case OPT_STATS_FIRST:
+        stats_first_specs.push_back(arg);
+        break;
+    case OPT_TRIGGER:
+        trigger_specs.push_back(arg);
+        break;
+    case OPT_TRACE_MARKER:
+        trace_marker = true;
+        trace_marker_path = arg;
+        break;
+    case OPT_COUNTERS:
+        shared_counters = true;
+        break;
+    case OPT_CAPTURE:
+        capture_file = arg;
+        break;
+    case OPT_REPLAY:
+        replay_file = arg;
+        break;
+    case OPT_STDOUT_LOG:
+        stdout_log_file = arg;
+        break;
+    case OPT_CORUN:
+        state.coruns.emplace_back(new Corun(arg));
+        break;
+    case OPT_AFFINITY:
+        benchmark_cpus = parse_cpu_list(arg, "--affinity");
+        benchmark_affinity = true;
+        break;
+    case OPT_WAIT_ALL:
+        wait_all = true;
+        break;
+    case OPT_DERIVE:
+        if (!strchr(arg, '='))
+            argp_error(argp_state, "--derive: Missing '=' in %s", arg);
+        derive_specs.push_back(arg);
+        break;
     case OPT_UNBUFFERED:
         csv_unbuffered = true;
         break;
@@ -914,6 +2252,74 @@ static error_t parse_opt(int key, char *arg, struct argp_state *argp_state)
         if (arg)
             sched_deadline_budget = atof(arg);
         break;
+    case OPT_FORMAT:
+        if (strcmp(arg, "wide") == 0)
+            out_format = CsvOutput::WIDE;
+        else if (strcmp(arg, "long") == 0)
+            out_format = CsvOutput::LONG;
+        else
+            argp_error(argp_state, "Unknown --format: %s", arg);
+        break;
+    case OPT_NO_MERGE:
+        merge_rows = false;
+        break;
+    case OPT_WINDOW:
+        window_ms = atof(arg);
+        if (window_ms <= 0)
+            argp_error(argp_state, "Invalid --window: %s", arg);
+        break;
+    case OPT_WINDOW_OUTPUT:
+        window_file = arg;
+        break;
+    case OPT_FLIGHT_RECORDER: {
+        char *end;
+        recorder_pre_ms = strtod(arg, &end) * 1000;
+        if (*end == ',')
+            recorder_post_ms = strtod(end + 1, &end) * 1000;
+        if (recorder_pre_ms <= 0 || *end != '\0' || recorder_post_ms < 0)
+            argp_error(argp_state, "Invalid --flight-recorder: %s", arg);
+        break;
+    }
+    case OPT_DUMP_ON:
+        dump_conditions.push_back(arg);
+        break;
+    case OPT_ROTATE_SIZE: {
+        char *end;
+        rotate_bytes = strtoll(arg, &end, 10);
+        switch (*end) {
+        case 'G':
+            rotate_bytes *= 1024;
+            [[fallthrough]];
+        case 'M':
+            rotate_bytes *= 1024;
+            [[fallthrough]];
+        case 'k':
+            rotate_bytes *= 1024;
+            end++;
+        }
+        if (rotate_bytes <= 0 || *end != '\0')
+            argp_error(argp_state, "Invalid --rotate-size: %s", arg);
+        break;
+    }
+    case OPT_ROTATE_TIME:
+        rotate_ms = atof(arg) * 1000;
+        if (rotate_ms <= 0)
+            argp_error(argp_state, "Invalid --rotate-time: %s", arg);
+        break;
+    case OPT_PUBLISH:
+        publish_path = arg;
+        break;
+    case OPT_METRICS:
+        metrics_addr = arg;
+        break;
+    case OPT_AGGREGATE: {
+        const char *eq = strrchr(arg, '=');
+        if (eq)
+            window_specs[string(arg, eq - arg)] = parseAggFuncs(eq + 1);
+        else
+            window_funcs = parseAggFuncs(arg);
+        break;
+    }
         /*     case ARGP_KEY_ARG: */
         /*         break; */
     case ARGP_KEY_ARGS:
@@ -923,12 +2329,29 @@ static error_t parse_opt(int key, char *arg, struct argp_state *argp_state)
             argp_error(argp_state, "COMMAND already specified with --benchmark");
         break;
     case ARGP_KEY_END:
-        if (!benchmark_argv)
+        if (!benchmark_argv && !replay_file)
             argp_error(argp_state, "COMMAND to run was not specified");
-        if (!sensors_specified && state.sensors.size() == 0)
-            add_all_thermal_zones();
-        if (!bench_name)
+        if (replay_file && capture_file)
+            argp_error(argp_state, "--capture cannot be used with --replay");
+        if (replay_file && stdout_log_file)
+            argp_error(argp_state, "--stdout-log cannot be used with --replay");
+        if (!sensors_specified && state.sensors.size() == 0) {
+            if (replay_file)
+                add_captured_sensors(replay_file);
+            else
+                add_all_thermal_zones();
+        }
+        if (!bench_name && replay_file) {
+            // Do not overwrite the output of the captured run
+            char *base = strdup(basename(replay_file));
+            char *dot = strrchr(base, '.');
+            if (dot && dot != base)
+                *dot = '\0';
+            CHECK(asprintf(&bench_name, "%s-replay", base));
+            free(base);
+        } else if (!bench_name) {
             bench_name = basename(benchmark_argv[0]);
+        }
         break;
     default:
         return ARGP_ERR_UNKNOWN;
@@ -946,14 +2369,93 @@ static struct argp_option options[] = {
     { "benchmark_path", 'b', 0,             OPTION_ALIAS | OPTION_HIDDEN },
     { "sensors_file",   's', "FILE",        0,
       "Definition of sensors to use. Each line of the FILE contains either "
-      "SPEC as in -S or, when the line starts with '!', the rest is "
-      "interpreted as an argument to --exec. Lines starting with '#' are "
+      "SPEC as in -S or, when the line starts with '!' or '~', the rest is "
+      "interpreted as an argument to --exec or --socket respectively. Lines starting with '#' are "
       "ignored. When no sensors are specified via -s or -S, all available "
       "thermal zones are added automatically." },
     { "sensor",         'S', "SPEC",        0,
       "Add a sensor to the list of used sensors. SPEC is FILE [NAME [UNIT]]. "
       "FILE is typically something like "
       "/sys/devices/virtual/thermal/thermal_zone0/temp " },
+    { "derive",         OPT_DERIVE, "NAME=EXPR", 0,
+
+      "Add column NAME (optionally with /UNIT) calculated from other columns by "
+      "the arithmetic expression EXPR in every --period row. EXPR can refer to columns "
+      "by their names, use operators + - * / % ^, functions abs, sqrt, exp, log, floor, "
+      "ceil, round, min(a,b), max(a,b), ifnan(x,default) and prev(COL), which returns "
+      "the last value of COL from previous rows. Example: "
+      "--derive 'energy/J=ifnan(prev(energy),0)+power*(time-prev(time))/1000'"
+
+    },
+    { "trigger",        OPT_TRIGGER, "COND:ACTION", 0,
+
+      "Execute ACTION whenever condition COND (e.g. CPU_0_temp>95000, see --dump-on) starts "
+      "to hold. ACTION is 'abort' to terminate the COMMAND (like --time), 'fan=SPEED' to "
+      "set the fan speed with --fan-cmd, 'mark[=TEXT]' to add a row with TEXT (default COND) "
+      "in column 'trigger' or 'exec=CMD' to run shell command CMD in background. "
+      "With --replay, only 'mark' actions are executed. Can be given multiple times."
+
+    },
+    { "trace-marker",   OPT_TRACE_MARKER, "FILE", OPTION_ARG_OPTIONAL,
+
+      "Write records about every row (time and filled cells as N=value, where N is the "
+      "0-based column index), COMMAND start and exit, fan changes and triggers to the "
+      "ftrace marker FILE (default /sys/kernel/tracing/trace_marker) to correlate "
+      "the measured data with kernel traces."
+
+    },
+    { "capture",        OPT_CAPTURE, "FILE", 0,
+
+      "Write all raw inputs, i.e. sensor values, CPU loads and data received from COMMAND, "
+      "--exec and --socket, together with their timestamps to binary FILE. The CSV can be "
+      "later regenerated from FILE with --replay."
+
+    },
+    { "replay",         OPT_REPLAY, "FILE", 0,
+
+      "Do not run any COMMAND, but process the inputs recorded in FILE by --capture. "
+      "Options controlling the output (e.g. --column, --derive, --window or --format) can "
+      "differ from the captured run. Sensors default to the captured ones, --exec and "
+      "--socket inputs are matched by their CMD and PATH. Unless -n or -O is given, the "
+      "output is named after FILE with '-replay' appended."
+
+    },
+    { "stats",          OPT_STATS, "FILE", 0,
+
+      "At the end, write statistics of all numeric columns (count, mean, variance, min, "
+      "max and last value) to FILE. For counter columns given by --rate or --energy, also "
+      "write the mean rate per second with its 95% interval and the same for the sum of all "
+      "rates (ops). FILE is JSON if its name ends with .json, key=value lines otherwise."
+
+    },
+    { "stats-first",    OPT_STATS_FIRST, "COND", 0,
+
+      "Include in --stats the time when condition COND (e.g. CPU_0_temp>80000, see "
+      "--dump-on) first holds. Can be given multiple times."
+
+    },
+    { "rate",           OPT_RATE, "COL", 0,
+
+      "Add column COL_rate with the per-second rate of change of counter COL (e.g. work_done "
+      "reported by the COMMAND) over each --period. Can be given multiple times."
+
+    },
+    { "energy",         OPT_ENERGY, "POWER[:WORK]", 0,
+
+      "Add column POWER_energy/J with the energy calculated by trapezoidal integration of "
+      "the POWER column (unit W, mW or µW). If counter column WORK is given, also add column "
+      "POWER_energy_per_WORK/J with the energy per unit of WORK in each --period. "
+      "Can be given multiple times."
+
+    },
+    { "oversample",     OPT_OVERSAMPLE, "SENSOR:PERIOD[:FILTER]", 0,
+
+      "Read SENSOR (given by its NAME) every PERIOD milliseconds, which is typically shorter "
+      "than --period, and store the filtered value in each row. FILTER is 'mean' (default) for "
+      "the average of samples taken since the previous row or 'lowpass=TC' for a first order "
+      "low-pass filter with time constant TC milliseconds. Can be given multiple times."
+
+    },
     { "wait",           'w', "TEMP [°C]",   0,
       "Wait for the temperature reported by the first configured sensor to be less or equal to TEMP "
       "before running the COMMAND. Wait timeout is given by --wait-timeout." },
@@ -969,8 +2471,54 @@ static struct argp_option options[] = {
     { "output_dir",     'o', "DIR",         0, "Where to create output .csv file" },
     { "output",         'O', "FILE",        0,
       "The name of output CSV file (overrides -o and -n). Hyphen (-) means standard output" },
-    { "column",         'c', "STR",         0, "Add column to CSV populated by STR=val lines from COMMAND stdout" },
+    { "column",         'c', "STR",         0,
+
+      "Add column to CSV populated by STR=val lines from COMMAND stdout. "
+      "STR:FUNC aggregates the values by FUNC over every --period as --exec does, "
+      "which is useful for keys printed many times per period. "
+      "Lines in the form STR@NS=val, where NS is CLOCK_MONOTONIC time in nanoseconds "
+      "(see tb_timestamp_ns() in benchmarks/tbcounters.h), are stored with that time "
+      "instead of the time they were read and the latter goes to the recv_time column. "
+      "Such rows can be older than the rows written before them, i.e. the time column "
+      "is then not monotonic. "
+      "If STR contains *, ? or [, it is a shell pattern (e.g. 'CPU*_work_done') and every "
+      "matching key gets its own column when it first appears. Such columns are announced by "
+      "'# column N: KEY' comments and the CSV header is completed when the output is closed."
+
+    },
     { "stdout",         'l', 0,             0, "Log COMMAND's stdout to CSV" },
+    { "stdout-log",     OPT_STDOUT_LOG, "FILE", 0,
+
+      "Copy raw COMMAND stdout to FILE. The data is moved to FILE by splice() without "
+      "passing through thermobench, or duplicated by tee() when it is also needed for "
+      "--column or --stdout. Records 'time,offset' in FILE.idx (at most one per --period) "
+      "map the CSV time to offsets in FILE. Use 2>&1 in COMMAND to include its stderr."
+
+    },
+    { "corun",          OPT_CORUN, "(PREFIX[@CPUS])CMD", 0,
+
+      "Run shell command CMD concurrently with COMMAND in its own process group. "
+      "Its KEY=value lines are handled as if COMMAND printed PREFIX_KEY=value, so they "
+      "can be stored with --column PREFIX_KEY, and its --stdout lines are prefixed by "
+      "'PREFIX: '. CPUS (e.g. 0-3,6) sets the CPU affinity of CMD. By default, "
+      "all commands are terminated when the first one exits (see --wait-all). "
+      "Can be given multiple times.\n"
+      //
+      "Example: --corun '(mem@4-5)./memkernel' --column mem_work_done"
+
+    },
+    { "affinity",       OPT_AFFINITY, "CPUS", 0, "Run COMMAND on CPUS (e.g. 0-3,6)" },
+    { "wait-all",       OPT_WAIT_ALL, 0,    0,
+      "Wait for COMMAND and all --corun commands to exit instead of terminating "
+      "the others when the first one exits." },
+    { "counters",       OPT_COUNTERS, 0,    0,
+
+      "Create a shared-memory region, where the COMMAND can publish named 64-bit counters "
+      "without printing them (see benchmarks/tbcounters.h). The counters are sampled "
+      "every --period and stored to the --column of the same name. The region is not "
+      "available to --corun commands."
+
+    },
     { "time",           't', "SECONDS",     0, "Terminate the COMMAND after this time" },
     { "cpu-usage",      'u', 0,             0, "Calculate and log CPU usage." },
     { "exec",           'e', "[(COL[,...])]CMD",  0,
@@ -981,15 +2529,100 @@ static struct argp_option options[] = {
       "COL start with '@' values are not stored immediately when received but "
       "the last value is remembered and stored synchronously with other "
       "sensors. Otherwise all non-matching lines will be stored in column "
-      "COL. If no COL is specified, first word of CMD is used as COL "
+      "COL. If COL (before '=') ends with ':FUNC', where FUNC is last, sum, "
+      "mean, min, max or count, all values received during a --period are "
+      "aggregated by FUNC and stored synchronously in column COL_FUNC. "
+      "KEY@NS= timestamps are supported as with --column. "
+      "If no COL is specified, first word of CMD is used as COL "
       "specification.\n"
       //
-      "Example: --exec '(amb1=,@amb2=,amb_other) ssh ambient@turbot read_temp'"
+      "Example: --exec '(amb1=,@amb2=,amb3:max=,amb_other) ssh ambient@turbot read_temp'"
 
     },
     { "exec-wait",      'E', 0,             0,
       "Wait for --exec processes to finish. Do not kill them (useful for testing)." },
+    { "socket",         OPT_SOCKET, "(COL[,...])PATH", 0,
+
+      "Connect to the Unix domain socket PATH (names starting with '@' denote "
+      "abstract sockets) and store the received lines in CSV columns specified "
+      "by COL in the same way as --exec does. This is more efficient than "
+      "running a program such as socat via --exec. When the connection cannot "
+      "be established or is closed, it is retried every second.\n"
+      //
+      "Example: --socket '(@ambient=,@energy=)/run/sensord/imx8'"
+
+    },
     { "unbuffered",     OPT_UNBUFFERED, 0,  0, "Flush CSV to disk after every row." },
+    { "format",         OPT_FORMAT, "FMT",  0,
+
+      "Layout of the output CSV file. FMT is either 'wide' (default) with one "
+      "column per value, or 'long' where each value is stored as a separate "
+      "'time,column,value' record. Column names of the long layout are listed "
+      "in the header. The long layout is more compact when most cells are empty, "
+      "e.g. with many --column keys."
+
+    },
+    { "window",         OPT_WINDOW, "TIME [ms]", 0,
+
+      "Aggregate values over windows of TIME milliseconds and store one row per window. "
+      "Each column is aggregated by functions given by --aggregate. Unless --window-output "
+      "is given, the aggregated rows are stored instead of the full-rate ones. "
+      "Rows are aggregated by their time, and a window is written only after the "
+      "next one is complete, so that rows with STR@NS timestamps (see --column) "
+      "arriving up to one window late are counted in the right window."
+
+    },
+    { "window-output",  OPT_WINDOW_OUTPUT, "FILE", 0,
+      "Store the aggregated rows to FILE and keep the full-rate rows in the main output." },
+    { "aggregate",      OPT_AGGREGATE, "[COL=]FUNC[,...]", 0,
+
+      "Aggregate functions used with --window. FUNC is one of last, min, max, mean, sum or count. "
+      "Every FUNC produces a separate column named after COL with '_FUNC' appended. "
+      "Without COL, the functions apply to all columns without their own "
+      "specification (default: min,max,mean,last). COL is the column header, "
+      "optionally without the unit."
+
+    },
+    { "flight-recorder", OPT_FLIGHT_RECORDER, "PRE[,POST]", 0,
+
+      "Do not write all rows, but keep the rows of the last PRE seconds in memory. "
+      "The rows are written out only when triggered by --dump-on condition, SIGUSR1 "
+      "or by COMMAND exiting with non-zero status. Rows received during POST seconds "
+      "after the trigger (default: PRE) are written too."
+
+    },
+    { "dump-on",        OPT_DUMP_ON, "COND", 0,
+      "Trigger the flight recorder when COND holds. COND has the form COL<op>NUM, where "
+      "COL is a column name, <op> is one of <, <=, >, >=, ==, != and NUM is a number. "
+      "Example: --dump-on='CPU_0_temp>95000'" },
+    { "rotate-size",    OPT_ROTATE_SIZE, "SIZE", 0,
+
+      "Split the output into segments of approximately SIZE bytes (suffixes k, M and G are "
+      "supported). Segments are named like FILE with a sequence number inserted before "
+      "the extension, e.g. data.0000.csv, and each starts with the CSV header. Disk space "
+      "for each segment is preallocated."
+
+    },
+    { "rotate-time",    OPT_ROTATE_TIME, "SECONDS", 0,
+      "Split the output into segments covering SECONDS each. See also --rotate-size." },
+    { "publish",        OPT_PUBLISH, "SOCKET", 0,
+
+      "Publish rows as they are produced to clients connected to the Unix domain SOCKET "
+      "(names starting with '@' denote abstract sockets). Clients first receive the CSV "
+      "header and then individual CSV rows. Rows for clients that do not keep up are "
+      "dropped rather than delaying the measurement."
+
+    },
+    { "metrics",        OPT_METRICS, "[HOST:]PORT", 0,
+
+      "Serve the latest value of every numeric column in the OpenMetrics (Prometheus) "
+      "text format over HTTP. HOST defaults to 127.0.0.1. Metrics are named "
+      "thermobench_<column> with the unit stripped."
+
+    },
+    { "no-merge",       OPT_NO_MERGE, 0,    0,
+      "Store every value received from COMMAND or --exec in a separate row. By default, "
+      "values received at the same time are merged into a single row." },
     { "verbose",        'v', 0,             0, "Print progress information to stderr." },
     { "sched-deadline", OPT_SCHED_DEADLINE, "BUDGET%", OPTION_ARG_OPTIONAL,
 
@@ -1122,14 +2755,34 @@ string cpu::getHeader(unsigned idx)
     return header.str();
 }
 
+static void print_results_stored(const CsvOutput &out)
+{
+    if (out.segmentCount() == 1)
+        fprintf(stderr, "Results stored to %s\n", out.segmentName(0).c_str());
+    else
+        fprintf(stderr, "Results stored to %s ... %s\n", out.segmentName(0).c_str(),
+                out.segmentName(out.segmentCount() - 1).c_str());
+}
+
 int main(int argc, char **argv)
 {
     argp_parse(&argp, argc, argv, 0, 0, NULL);
 
-    if (!isnan(cooldown_temp))
+    state.stdoutIndex = index_keys(state.stdoutColumns);
+
+    if (trace_marker)
+        state.trace.reset(new TraceMarker(trace_marker_path ? trace_marker_path : ""));
+
+    for (const string &spec : oversample_specs) {
+        Oversampler *o = Oversampler::parse(spec);
+        state.sensors[o->sensor_idx].oversampler = state.oversamplers.size();
+        state.oversamplers.emplace_back(o);
+    }
+
+    if (!isnan(cooldown_temp) && !replay_file)
         wait_cooldown(fan_cmd);
 
-    if (!isnan(fan_on) && fan_cmd)
+    if (!isnan(fan_on) && fan_cmd && !replay_file)
         set_fan(fan_cmd, fan_on);
 
     if (!out_file)
@@ -1140,37 +2793,134 @@ int main(int argc, char **argv)
         read_procstat(); // first read to initialize cpu_usage vars
     }
 
-    if (strcmp(out_file, "-") != 0) {
-        if (verbose)
-            fprintf(stderr, "Opening %s\n", out_file);
-        state.out_fp = fopen(out_file, "w+");
+    if (write_stdout)
+        stdout_column = &(columns.add("stdout"));
+
+    if (shared_counters && !replay_file)
+        state.counters.reset(new SharedCounters());
+
+    if (!rate_specs.empty() || !energy_specs.empty()) {
+        state.rates.reset(new Rates(columns, time_column));
+        for (const string &spec : rate_specs)
+            state.rates->addRate(spec);
+        for (const string &spec : energy_specs) {
+            size_t colon = spec.find(':');
+            state.rates->addEnergy(spec.substr(0, colon), colon == string::npos ? "" : spec.substr(colon + 1));
+        }
+    }
+
+    // Add all derived columns first to allow referencing them from
+    // any expression
+    vector<const CsvColumn *> derived_columns;
+    for (const string &spec : derive_specs)
+        derived_columns.push_back(&columns.add(spec.substr(0, spec.find('='))));
+    for (unsigned i = 0; i < derive_specs.size(); i++) {
+        const string &spec = derive_specs[i];
+        state.derived.push_back({ *derived_columns[i], Expr(spec.substr(spec.find('=') + 1), columns) });
+    }
+
+    if (window_ms > 0) {
+        state.aggregator.reset(new Aggregator(columns, time_column, window_ms, window_funcs, window_specs));
+        state.window_out.reset(new CsvOutput(state.aggregator->columns, state.aggregator->time_column, out_format));
+        // Without --window-output, the aggregated rows replace the full-rate ones
+        if (window_file)
+            state.out.reset(new CsvOutput(columns, time_column, out_format));
+        else
+            window_file = out_file;
     } else {
-        state.out_fp = fdopen(STDOUT_FILENO, "w");
+        state.out.reset(new CsvOutput(columns, time_column, out_format));
     }
-    if (state.out_fp == NULL)
-        err(1, "open(%s)", out_file);
 
-    fprintf(state.out_fp, "# Started at: %s, Version: %s, Generated by: %s\n", current_time().c_str(), GIT_VERSION,
-            shell_quote(argc, argv).c_str());
+    if (recorder_pre_ms > 0) {
+        if (isnan(recorder_post_ms))
+            recorder_post_ms = recorder_pre_ms;
+        size_t capacity = 2 * (recorder_pre_ms / measure_period_ms + 1);
+        state.recorder.reset(new FlightRecorder(columns, time_column, recorder_pre_ms, recorder_post_ms, capacity));
+        for (const string &spec : dump_conditions)
+            state.dump_conditions.push_back(Condition::parse(spec, columns));
+    } else if (!dump_conditions.empty()) {
+        errx(1, "--dump-on requires --flight-recorder");
+    }
 
-    if (write_stdout)
-        stdout_column = &(columns.add("stdout"));
-    CsvRow row(columns);
-    columns.setHeader(row);
-    row.write(state.out_fp);
+    for (const string &spec : trigger_specs) {
+        state.triggers.push_back(Trigger::parse(spec, columns));
+        if (state.triggers.back().action == Trigger::MARK && !state.trigger_column)
+            state.trigger_column = &columns.add("trigger");
+    }
+
+    if (stats_file) {
+        vector<Condition> conditions;
+        for (const string &spec : stats_first_specs)
+            conditions.push_back(Condition::parse(spec, columns));
+        vector<const CsvColumn *> counters;
+        if (state.rates)
+            counters = state.rates->counterColumns();
+        state.stats.reset(new RunStats(columns, time_column, counters, conditions));
+    } else if (!stats_first_specs.empty()) {
+        errx(1, "--stats-first requires --stats");
+    }
+
+    const string comment = "Started at: " + current_time() + ", Version: " GIT_VERSION
+        + ", Generated by: " + shell_quote(argc, argv);
+    state.header_comment = comment;
+    if (publish_path)
+        state.publisher.reset(new Publisher(publish_path));
+    if (metrics_addr)
+        state.metrics.reset(new MetricsServer(columns, metrics_addr));
+    if (state.out) {
+        if (verbose && strcmp(out_file, "-") != 0)
+            fprintf(stderr, "Opening %s\n", out_file);
+        state.out->setRotation(rotate_bytes, rotate_ms);
+        state.out->open(out_file);
+        state.out->writeHeader(comment);
+    }
+    if (state.window_out) {
+        if (verbose && strcmp(window_file, "-") != 0)
+            fprintf(stderr, "Opening %s\n", window_file);
+        state.window_out->setRotation(rotate_bytes, rotate_ms);
+        state.window_out->open(window_file);
+        state.window_out->writeHeader(comment);
+    }
+    if (capture_file) {
+        state.capture.reset(new CaptureWriter(capture_file));
+        capture_definitions(comment);
+    }
+    if (stdout_log_file)
+        state.stdout_log.reset(new StdoutLog(stdout_log_file, measure_period_ms));
     if (csv_unbuffered)
-        fflush(state.out_fp);
+        flush_output();
 
     // Clear signal mask in children - don't let them inherit our
     // mask, which libev "randomly" modifies
     pthread_atfork(0, 0, clear_sig_mask);
 
-    measure(measure_period_ms);
-
-    fclose(state.out_fp);
-
-    if (strcmp(out_file, "-") != 0)
-        fprintf(stderr, "Results stored to %s\n", out_file);
+    if (replay_file)
+        replay(replay_file);
+    else
+        measure(measure_period_ms);
+
+    state.capture.reset();
+    state.stdout_log.reset();
+    state.publisher.reset();
+    state.metrics.reset();
+
+    if (state.aggregator)
+        state.aggregator->finish(*state.window_out);
+    if (state.out)
+        state.out->close();
+    if (state.window_out)
+        state.window_out->close();
+
+    if (state.out && strcmp(out_file, "-") != 0)
+        print_results_stored(*state.out);
+    if (state.window_out && strcmp(window_file, "-") != 0)
+        print_results_stored(*state.window_out);
+
+    if (state.stats) {
+        state.stats->write(stats_file, comment);
+        if (verbose)
+            fprintf(stderr, "Statistics stored to %s\n", stats_file);
+    }
 
     return 0;
 }
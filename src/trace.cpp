@@ -0,0 +1,59 @@
+#include "trace.h"
+#include <algorithm>
+#include <err.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *default_paths[] = {
+    "/sys/kernel/tracing/trace_marker",
+    "/sys/kernel/debug/tracing/trace_marker",
+};
+
+TraceMarker::TraceMarker(const string &path)
+{
+    if (!path.empty()) {
+        fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (fd == -1)
+            err(1, "open(%s)", path.c_str());
+        return;
+    }
+    for (const char *p : default_paths) {
+        fd = open(p, O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (fd != -1)
+            return;
+    }
+    err(1, "open(%s)", default_paths[0]);
+}
+
+TraceMarker::~TraceMarker()
+{
+    if (fd != -1)
+        close(fd);
+}
+
+void TraceMarker::write(const char *fmt, ...)
+{
+    // The kernel truncates longer records anyway
+    char buf[1024];
+    const char prefix[] = "thermobench: ";
+    size_t len = sizeof(prefix) - 1;
+    memcpy(buf, prefix, len);
+
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = vsnprintf(buf + len, sizeof(buf) - len - 1, fmt, ap);
+    va_end(ap);
+    if (ret < 0)
+        return;
+    len = min(len + ret, sizeof(buf) - 2);
+    if (buf[len - 1] != '\n')
+        buf[len++] = '\n';
+
+    if (::write(fd, buf, len) == -1 && !failed) {
+        warn("trace_marker write");
+        failed = true; // Do not flood stderr
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+
+using namespace std;
+
+// Writes records to the ftrace trace_marker file so that they appear
+// in kernel traces (trace-cmd, perf) interleaved with kernel events.
+// The file is opened once and kept open to make writes cheap.
+class TraceMarker {
+public:
+    // Empty path means the default tracefs location
+    TraceMarker(const string &path);
+    ~TraceMarker();
+
+    TraceMarker(const TraceMarker &) = delete;
+    void operator=(const TraceMarker &) = delete;
+
+    void write(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+private:
+    int fd = -1;
+    bool failed = false;
+};
+
+#endif
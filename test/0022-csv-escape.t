@@ -1,6 +1,6 @@
 #!/usr/bin/env bash
 . testlib
-plan_tests 4
+plan_tests 7
 
 out=$(thermobench -O- -S'/dev/null comma,comma' -- true)
 ok $? "exit code"
@@ -9,3 +9,10 @@ is "$(sed -ne 2p <<<$out)" 'time/ms,"comma,comma"' "comma escaped by quoting"
 out=$(thermobench -O- -S'/dev/null quote"quote' -- true)
 ok $? "exit code"
 is "$(sed -ne 2p <<<$out)" 'time/ms,"quote""quote"' "quote escaped by quoting and doubling"
+
+out=$(thermobench -O- -s/dev/null --stdout -- echo 'a "long" line with "quotes", commas')
+ok $? "exit code"
+like "$(sed -ne 3p <<<$out)" '^[0-9.]+,"a ""long"" line with ""quotes"", commas"$' "long line escaped"
+
+out=$(thermobench -O- -s/dev/null --stdout -- echo 'no special characters in this long line')
+like "$(sed -ne 3p <<<$out)" '^[0-9.]+,no special characters in this long line$' "long line not escaped"
@@ -1,6 +1,6 @@
 #!/usr/bin/env bash
 . testlib
-plan_tests 6
+plan_tests 9
 
 out=$(thermobench -O- -s/dev/null --column=key -- echo key=value)
 okx grep -E "time/ms,key" <<<$out
@@ -13,3 +13,13 @@ is "$(grep -o ",value.*" <<<$out)" ",value1,value2" "values 1 and 2 on the same
 readarray -t lines <<<"$(thermobench -O- -s/dev/null --column=key{1,2,3,4} -- printf 'key1=value1\n')"
 is   "${lines[1]}" "time/ms,key1,key2,key3,key4" "header has 4 key columns"
 like "${lines[2]}" "[0-9.],value1,,," "row ends with empty cells"
+
+# Values starting like a number are stored as text and reported once
+err=$(thermobench -O/dev/null -s/dev/null --column=t -- printf 't=12ms\nt=13ms\n' 2>&1 >/dev/null)
+is "$(grep -c Malformed <<<$err)" 1 "malformed value reported once"
+like "$err" "column t: 12ms" "malformed value"
+
+# Numbers are parsed when stored; others are ignored by statistics
+thermobench -O/dev/null -s/dev/null --stats=column-stats.txt --column=k -- printf 'k=+5\nk=1e3\nk=x\n' 2>/dev/null
+is "$(grep -E '^k\.(count|max)=' column-stats.txt | tr '\n' ' ')" "k.count=2 k.max=1000 " "numeric values"
+rm -f column-stats.txt
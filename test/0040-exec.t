@@ -1,6 +1,6 @@
 #!/usr/bin/env bash
 . testlib
-plan_tests 27
+plan_tests 30
 
 out=$(thermobench -O- -s/dev/null -E --exec="echo value" -- true)
 ok $? "exit code"
@@ -64,3 +64,9 @@ is "${line[1]}" "time/ms,uptime,seq,other"
 for i in $(seq 9); do grep -q "val$i" <<<$out && (( matches++ )); done
 # Most likely only one value appears in the output. In the worst case three values (almost never 9)
 okx test $matches -ge 1 -a $matches -le 3
+
+# CR before LF is stripped, last line does not need to be terminated
+out=$(thermobench -O- -s/dev/null -E --exec='(key=) printf "key=val1\r\nkey=val2"' -- true)
+ok $? "exit code"
+okx grep -qE '^[0-9.]+,val1$' <<<$out
+okx grep -qE '^[0-9.]+,val2$' <<<$out
@@ -0,0 +1,19 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 9
+
+out=$(thermobench -O- -s/dev/null --format=long --column=key{1,2} -- printf 'key1=value1\nkey2=value2\nkey2=value3\n')
+ok $? "exit code"
+readarray -t lines <<<"$out"
+is   "${lines[1]}" "# column 1: key1" "column dictionary"
+is   "${lines[2]}" "# column 2: key2" "column dictionary"
+is   "${lines[3]}" "time/ms,column,value" "header"
+like "${lines[4]}" "[0-9.]+,1,value1$" "key1 record"
+like "${lines[6]}" "[0-9.]+,2,value3$" "repeated key record"
+
+out=$(thermobench -O- -s/dev/null --format=foo -- true 2>&1)
+is $? 64 "unknown format"
+
+readarray -t lines <<<"$(thermobench -O- -s/dev/null --no-merge --column=key{1,2} -- printf 'key1=value1\nkey2=value2\n')"
+like "${lines[2]}" "[0-9.]+,value1,$" "first value in own row"
+like "${lines[3]}" "[0-9.]+,,value2$" "second value in own row"
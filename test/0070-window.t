@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 10
+
+out=$(thermobench -O- -S'/proc/uptime uptime s' --window=200 -p 50 -- sleep 0.5)
+ok $? "exit code"
+readarray -t lines <<<"$out"
+is "${lines[1]}" "time/ms,uptime_min/s,uptime_max/s,uptime_mean/s,uptime_last/s" "default aggregate functions"
+like "${lines[2]}" "^0,[0-9.]+,[0-9.]+,[0-9.]+,[0-9.]+$" "first window"
+like "${lines[3]}" "^200,[0-9.,]+$" "second window"
+
+out=$(thermobench -O- -s/dev/null --window=10000 --aggregate=key=sum,count,last --column=key -- printf 'key=1\nkey=2\nkey=3\n')
+ok $? "exit code"
+is "$(sed -ne 2p <<<$out)" "time/ms,key_sum,key_count,key_last" "header"
+is "$(sed -ne 3p <<<$out)" "0,6,3,3" "aggregated values"
+
+out=$(thermobench -O- -s/dev/null --window=1000 --window-output=/dev/null --column=key -- echo key=1)
+is "$(sed -ne 2p <<<$out)" "time/ms,key" "--window-output keeps full rate output"
+
+out=$(thermobench -O- -s/dev/null --window=1000 --aggregate=nokey=max -- true 2>&1)
+is $? 1 "unknown column"
+
+# Windows of multi-day runs - replay a capture shifted by 1e8 ms
+thermobench -O/dev/null -s/dev/null --column=key --capture=window-test.cap -- \
+            sh -c 'for i in 1 2 3 4 5 6 7 8 9 10; do echo key=$i; sleep 0.1; done' 2>/dev/null
+shift_capture window-test.cap window-test-late.cap 1e8
+windows() {
+    thermobench -O- -s/dev/null --window=200 --aggregate=key=count --column=key --replay=$1 2>/dev/null | grep -v '^#' | sed 1d
+}
+is "$(windows window-test-late.cap)" "$(windows window-test.cap | awk -F, '{ printf "%d,%s\n", $1 + 1e8, $2 }')" "windows at large times"
+rm -f window-test.cap window-test-late.cap
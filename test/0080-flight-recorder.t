@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 9
+
+out=$(thermobench -O- -S/proc/uptime -p 50 --flight-recorder=0.1 -- sleep 0.3)
+ok $? "exit code"
+is "$(wc -l <<<$out)" 2 "nothing stored without trigger"
+
+out=$(thermobench -O- -S'/proc/uptime up' -p 50 --flight-recorder=0.1,0.1 --column=key --dump-on='key>5' -- sh -c 'sleep 0.3; echo key=6; sleep 0.5')
+ok $? "exit code"
+is "$(sed -ne 3p <<<$out)" "# Flight recorder triggered by key>5" "trigger comment"
+okx grep -qE '^[0-9.]+,,6$' <<<$out
+lines=$(grep -c '^[0-9]' <<<$out)
+okx test $lines -ge 4 -a $lines -le 9
+
+out=$(thermobench -O- -S'/proc/uptime up' -p 50 --flight-recorder=0.1 -- sh -c 'sleep 0.3; kill -USR1 $PPID; sleep 0.2')
+okx grep -q "triggered by SIGUSR1" <<<$out
+
+out=$(thermobench -O- -S'/proc/uptime up' -p 50 --flight-recorder=0.1 -- sh -c 'sleep 0.3; exit 3')
+okx grep -q "triggered by abnormal COMMAND exit" <<<$out
+
+out=$(thermobench -O- -s/dev/null --flight-recorder=1 --dump-on='nokey>1' -- true 2>&1)
+is $? 1 "unknown column"
@@ -0,0 +1,19 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 7
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+thermobench -O "$dir/data.csv" -S/proc/uptime -p 20 --rotate-size=300 -- sleep 0.5 2>/dev/null
+ok $? "exit code"
+okx test -f "$dir/data.0000.csv" -a -f "$dir/data.0001.csv"
+is "$(sed -ne 2p "$dir/data.0001.csv")" "time/ms,proc" "every segment has header"
+okx test "$(stat -c %s "$dir/data.0000.csv")" -lt 400
+
+thermobench -O "$dir/time.csv" -S/proc/uptime -p 20 --rotate-time=0.2 -- sleep 0.5 2>/dev/null
+ok $? "exit code"
+okx test -f "$dir/time.0002.csv"
+
+out=$(thermobench -O- -s/dev/null --rotate-time=1 -- true 2>&1)
+is $? 1 "rotation of stdout fails"
@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 6
+
+sock=$PWD/publish-test.sock
+rm -f $sock
+
+read_socket() {
+    perl -MIO::Socket::UNIX -e '
+        my $path = shift;
+        my $s;
+        for (1..50) { last if $s = IO::Socket::UNIX->new(Peer => $path); select(undef, undef, undef, 0.05); }
+        die "connect: $!" unless $s;
+        print while <$s>;' "$1"
+}
+
+thermobench -O- -S'/proc/uptime up' -p 50 --publish=$sock -- sleep 1 > publish-test.csv &
+pid=$!
+out=$(read_socket $sock)
+wait $pid
+ok $? "exit code"
+like "$(sed -ne 1p <<<$out)" "^# Started at:" "header comment"
+is "$(sed -ne 2p <<<$out)" "time/ms,up" "header row"
+okx grep -qE '^[0-9.]+,[0-9.]+$' <<<$out
+okx test ! -e $sock
+rm -f publish-test.csv
+
+out=$(thermobench -O/dev/null -s/dev/null --publish=/nonexistent/dir/sock -- true 2>&1)
+is $? 1 "bad socket path"
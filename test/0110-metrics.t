@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 8
+
+port=$((20000 + $$ % 20000))
+
+scrape() {
+    perl -MIO::Socket::INET -e '
+        my $s;
+        for (1..50) { last if $s = IO::Socket::INET->new("127.0.0.1:$ARGV[0]"); select(undef, undef, undef, 0.05); }
+        die "connect: $!" unless $s;
+        print $s "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        print while <$s>;' $1 | tr -d '\r'
+}
+
+thermobench -O/dev/null -S'/proc/uptime up/s' -p 50 --column=key --column=nan --column=hex --metrics=$port -- \
+            sh -c 'echo key=42; echo nan=nan; echo hex=0x10; sleep 1' 2>/dev/null &
+pid=$!
+sleep 0.3
+out=$(scrape $port)
+wait $pid
+ok $? "exit code"
+is "$(sed -ne 1p <<<$out)" "HTTP/1.1 200 OK" "status"
+okx grep -q '^# TYPE thermobench_up gauge$' <<<$out
+okx grep -qE '^thermobench_up [0-9.]+$' <<<$out
+okx grep -q '^thermobench_key 42$' <<<$out
+okx grep -q '^thermobench_nan NaN$' <<<$out
+is "$(grep -c '^thermobench_hex' <<<$out)" 0 "malformed value not exported"
+is "$(tail -n1 <<<$out)" "# EOF" "EOF marker"
@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 6
+
+# Stand-in for utils/sensord: serve two connections, each sending a
+# few lines and closing the connection
+serve() {
+    perl -MIO::Socket::UNIX -e '
+        my $path = shift;
+        my $l = IO::Socket::UNIX->new(Local => $path, Listen => 1) or die "listen: $!";
+        for my $i (1..2) {
+            my $c = $l->accept;
+            print $c "ambient=2$i\nenergy=$i.5\nhello\n";
+            select(undef, undef, undef, 0.3);
+            close $c;
+        }
+        unlink $path unless $path =~ /^\0/;' "$1"
+}
+
+sock=$PWD/socket-test.sock
+rm -f $sock
+serve $sock &
+server=$!
+sleep 0.2
+out=$(thermobench -O- -S'/proc/uptime up' -p 100 --socket="(@ambient=,energy=,rest)$sock" -- sleep 2 2>/dev/null)
+ok $? "exit code"
+is "$(sed -ne 2p <<<$out)" "time/ms,up,ambient,energy,rest" "header"
+okx grep -qE '^[0-9.]+,[0-9.]+,21,,$' <<<$out
+okx grep -qE '^[0-9.]+,,,1.5,hello$' <<<$out
+okx grep -qE '^[0-9.]+,[0-9.]+,22,,$' <<<$out
+kill $server 2>/dev/null
+rm -f $sock
+
+out=$(thermobench -O/dev/null -s/dev/null --socket=/nonexistent -- true 2>&1)
+is $? 1 "missing columns"
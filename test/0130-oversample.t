@@ -0,0 +1,26 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 7
+
+# Sensor value steps from 0 to 1000 in the middle of the run
+step() {
+    echo 0 > oversample-test.val
+    thermobench -O- -S"$PWD/oversample-test.val power" -p 100 "$@" -- sh -c '
+        sleep 0.5; echo 1000 > oversample-test.new; mv oversample-test.new oversample-test.val; sleep 0.8'
+}
+
+out=$(step --oversample=power:10:lowpass=200)
+ok $? "exit code"
+values=$(sed -ne '3,$s/.*,//p' <<<$out)
+is "$(head -n1 <<<$values)" 0 "initial value"
+okx awk '$1 > 0 && $1 < 900 { found=1 } END { exit !found }' <<<"$values"
+okx awk '{ last=$1 } END { exit !(last > 900 && last < 1000) }' <<<"$values"
+
+out=$(step --oversample=power:10:mean)
+is "$(tail -n1 <<<$out | sed -e 's/.*,//')" 1000 "mean"
+
+out=$(thermobench -O/dev/null -s/dev/null --oversample=nosensor:10 -- true 2>&1)
+is $? 1 "unknown sensor"
+out=$(thermobench -O/dev/null -S'/proc/uptime up' --oversample=up:10:median -- true 2>&1)
+is $? 1 "unknown filter"
+rm -f oversample-test.val
@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 8
+
+echo 2500 > derive-test.val
+out=$(thermobench -O- -S"$PWD/derive-test.val temp m°C" -p 100 \
+                  --derive 'temp_C/°C=temp/1000' \
+                  --derive 'count=ifnan(prev(count),0)+1' \
+                  --derive 'x=max(2^3, -sqrt(16)) % 5 - -1' \
+                  --derive 'dt=time-prev(time)' \
+                  -- sleep 0.35)
+ok $? "exit code"
+is "$(sed -ne 2p <<<$out)" "time/ms,temp/m°C,temp_C/°C,count,x,dt" "header"
+okx grep -qE '^[0-9.]+,2500,2.5,1,4,$' <<<$out
+okx grep -qE '^[0-9.]+,2500,2.5,3,4,[0-9.]+$' <<<$out
+rm -f derive-test.val
+
+out=$(thermobench -O/dev/null -s/dev/null --derive 'x=nocol*2' -- true 2>&1)
+is $? 1 "unknown column"
+out=$(thermobench -O/dev/null -s/dev/null --derive 'x=(1+2' -- true 2>&1)
+is $? 1 "syntax error"
+is "$out" "thermobench: --derive: Expected ')' at position 5: (1+2" "error message"
+out=$(thermobench -O/dev/null -s/dev/null --derive 'x=foo(1)' -- true 2>&1)
+is $? 1 "unknown function"
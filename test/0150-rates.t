@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 8
+
+echo 2000 > rates-test.val
+out=$(thermobench -O- -S"$PWD/rates-test.val power mW" -p 200 --column=work_done \
+                  --rate=work_done --energy=power:work_done -- \
+                  sh -c 'i=0; while [ $i -lt 20 ]; do i=$((i+1)); echo work_done=$((i*10)); sleep 0.05; done')
+ok $? "exit code"
+is "$(sed -ne 2p <<<$out)" "time/ms,power/mW,work_done,work_done_rate/s,power_energy/J,power_energy_per_work_done/J" "header"
+is "$(sed -ne 3p <<<$out | cut -d, -f5)" 0 "initial energy"
+# The last periodic row has energy = 2 W * time
+okx awk -F, '$2 != "" { t=$1; e=$5 } END { exit !(e > 0 && (e - 2*t/1000)^2 < 1e-6) }' <<<"$out"
+# Work rate is about 10 per 50 ms
+okx awk -F, '$4 != "" { r=$4 } END { exit !(r > 150 && r < 210) }' <<<"$out"
+okx awk -F, '$6 != "" { x=$6 } END { exit !(x > 0.008 && x < 0.012) }' <<<"$out"
+
+# Times of multi-day runs do not fit the 6 significant digits of the
+# CSV - replay a capture shifted by 1e8 ms (about 28 hours)
+thermobench -O/dev/null -S"$PWD/rates-test.val power mW" -p 200 --column=work_done --capture=rates-test.cap -- \
+            sh -c 'i=0; while [ $i -lt 20 ]; do i=$((i+1)); echo work_done=$((i*10)); sleep 0.05; done' 2>/dev/null
+shift_capture rates-test.cap rates-test-late.cap 1e8
+for cap in rates-test.cap rates-test-late.cap; do
+    thermobench -O- -S"$PWD/rates-test.val power mW" --column=work_done \
+                --rate=work_done --energy=power:work_done --replay=$cap 2>/dev/null |
+        awk -F, '$2 != "" { print $4, $5 }' | tail -n1
+done > rates-test.out
+okx awk 'NR == 1 { r=$1; e=$2 } END { exit !(r > 0 && ($1 - r)^2 < 1e-6 && ($2 - e)^2 < 1e-9) }' rates-test.out
+rm -f rates-test.val rates-test.cap rates-test-late.cap rates-test.out
+
+out=$(thermobench -O/dev/null -s/dev/null --rate=nocol -- true 2>&1)
+is $? 1 "unknown column"
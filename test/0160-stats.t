@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 10
+
+echo 42 > stats-test.val
+thermobench -O/dev/null -S"$PWD/stats-test.val val" -p 100 --column=CPU0_work_done --rate=CPU0_work_done \
+            --stats=stats-test.txt --stats-first='CPU0_work_done>50' -- \
+            sh -c 'for i in 1 2 3 4 5 6 7 8 9 10; do echo CPU0_work_done=${i}0; sleep 0.05; done' 2>/dev/null
+ok $? "exit code"
+out=$(cat stats-test.txt)
+okx grep -qx 'val.mean=42' <<<$out
+okx grep -qx 'val.variance=0' <<<$out
+okx grep -qx 'CPU0_work_done.count=10' <<<$out
+okx grep -qx 'CPU0_work_done.mean=55' <<<$out
+okx grep -qE '^CPU0_work_done.rate=1[0-9]{2}(\.[0-9]+)?$' <<<$out
+okx grep -qE '^ops=1[0-9]{2}(\.[0-9]+)?$' <<<$out
+okx grep -qE '^first_time.CPU0_work_done>50=[0-9.]+$' <<<$out
+
+thermobench -O/dev/null -S"$PWD/stats-test.val val" -p 100 --stats=stats-test.json -- sleep 0.15 2>/dev/null
+okx grep -q '"val": { "count": 2, "mean": 42, "variance": 0, "min": 42, "max": 42, "last": 42 }' stats-test.json
+
+out=$(thermobench -O/dev/null -s/dev/null --stats-first='x>1' -- true 2>&1)
+is $? 1 "--stats-first without --stats"
+rm -f stats-test.val stats-test.txt stats-test.json
@@ -0,0 +1,21 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 8
+
+rm -f trigger-test.log
+out=$(thermobench -O- -s/dev/null --column=temp --fan-cmd="echo fan >> trigger-test.log" \
+                  --trigger='temp>50:mark' --trigger='temp>50:fan=0.7' \
+                  --trigger='temp>50:exec=echo exec >> trigger-test.log' --trigger='temp>90:abort' -- \
+                  sh -c 'for t in 10 60 70 20 60 95; do echo temp=$t; sleep 0.1; done; sleep 5; echo temp=1' 2>/dev/null)
+ok $? "exit code"
+is "$(sed -ne 2p <<<$out)" "time/ms,temp,trigger" "header"
+is "$(grep -c ',temp>50$' <<<$out)" 2 "mark rows on rising edges"
+okx grep -qE '^[0-9.]+,95,$' <<<$out
+okx test "$(grep -c ',1,$' <<<$out)" = 0 # aborted
+sleep 0.2
+is "$(grep -c 'fan 0.7' trigger-test.log)" 2 "fan action"
+is "$(grep -c 'exec' trigger-test.log)" 2 "exec action"
+rm -f trigger-test.log
+
+out=$(thermobench -O/dev/null -s/dev/null --column=temp --trigger='temp>1:explode' -- true 2>&1)
+is $? 1 "unknown action"
@@ -0,0 +1,18 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 6
+
+# A regular file stands in for tracefs trace_marker
+: > trace-test.marker
+thermobench -O/dev/null -s/dev/null -p 100 --column=t --trigger='t>1:mark' --trace-marker=trace-test.marker -- \
+            sh -c 'echo t=2; sleep 0.1' 2>/dev/null
+ok $? "exit code"
+out=$(cat trace-test.marker)
+like "$(sed -ne 1p <<<$out)" "^thermobench: start pid=[0-9]+$" "start record"
+okx grep -qE '^thermobench: row [0-9.]+ 1=2$' <<<$out
+okx grep -qx 'thermobench: trigger t>1' <<<$out
+is "$(tail -n1 <<<$out)" "thermobench: exit status=0" "exit record"
+rm -f trace-test.marker
+
+out=$(thermobench -O/dev/null -s/dev/null --trace-marker=/nonexistent/trace_marker -- true 2>&1)
+is $? 1 "missing marker file"
@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 9
+
+echo 42000 > capture-test.sensor
+thermobench -O capture-test.csv -S 'capture-test.sensor temp mC' -p 100 --column=a --exec='(x=)echo x=1' \
+            --capture=capture-test.tbcap -- sh -c 'echo a=1; echo b=5; sleep 0.25; echo a=2; echo b=7' 2>/dev/null
+ok $? "capture"
+
+# Unchanged configuration reproduces the original output
+thermobench -O capture-test-replay.csv -S 'capture-test.sensor temp mC' --column=a --exec='(x=)echo x=1' --replay=capture-test.tbcap 2>/dev/null
+ok $? "replay"
+is "$(sed 1d capture-test-replay.csv)" "$(sed 1d capture-test.csv)" "replay output equals original"
+
+# Columns not configured during the capture can be added
+out=$(thermobench -O - --column=b --replay=capture-test.tbcap 2>/dev/null)
+is "$(sed -ne 2p <<<$out)" "time/ms,b,temp/mC" "replay header"
+okx grep -qE '^[0-9.]+,5,$' <<<$out
+okx grep -qE '^[0-9.]+,7,$' <<<$out
+
+thermobench -O /dev/null -S 'other.sensor' --replay=capture-test.tbcap 2>/dev/null
+is $? 1 "sensor missing in capture"
+
+# Triggers other than mark do not act during replay
+out=$(thermobench -O - --column=b --trigger='b>6:exec=touch capture-test.exec' --trigger='b>6:mark' \
+                  --replay=capture-test.tbcap 2>/dev/null)
+okx grep -qE '^[0-9.]+,,,b>6$' <<<$out
+okx test ! -e capture-test.exec
+
+rm -f capture-test.exec capture-test.sensor capture-test.csv capture-test-replay.csv capture-test.tbcap
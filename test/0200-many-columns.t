@@ -0,0 +1,18 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 4
+
+keys=$(seq -f 'CPU%g_work_done' 0 199)
+args=$(sed 's/^/--column=/' <<<$keys)
+for k in $keys; do echo $k=${k#CPU}; done > many-columns.in
+echo CPU=x >> many-columns.in
+echo CPU1_work_don=y >> many-columns.in
+# All lines are read at once and stored in a single row
+out=$(thermobench -O - -s/dev/null $args -- cat many-columns.in 2>/dev/null)
+ok $? "exit code"
+row=$(sed -ne 3p <<<$out)
+is "$(cut -d, -f2 <<<$row)" "0_work_done" "first column"
+is "$(cut -d, -f201 <<<$row)" "199_work_done" "last column"
+# Lines with keys not matching any column are ignored
+is "$(wc -l <<<$out)" 3 "unknown keys"
+rm -f many-columns.in
@@ -0,0 +1,16 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 5
+
+# Line longer than the buffer (64 KiB) is truncated, parsing continues
+# with the next line
+out=$(thermobench -O - -s/dev/null --stdout --column=a -- \
+                  sh -c 'head -c 100000 /dev/zero | tr "\0" x; echo; echo a=1' 2>long-line.err)
+ok $? "exit code"
+like "$(cat long-line.err)" "line longer than 65536 bytes truncated" "warning"
+is "$(sed -ne 3p <<<$out | cut -d, -f3 | tr -d "\n" | wc -c)" 65536 "truncated line"
+okx grep -qE '^[0-9.]+,1,$' <<<$out
+rm -f long-line.err
+
+out=$(thermobench -O - -s/dev/null --column=a -- seq -f a=%g 100000 2>/dev/null)
+is "$(tail -n1 <<<$out | cut -d, -f2)" 100000 "many lines"
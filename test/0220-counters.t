@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 4
+
+# Register counter "work" with value 42 like tb_counter_add() and
+# tb_counter_set() from benchmarks/tbcounters.h
+publish='
+open(my $f, "+<", $ENV{THERMOBENCH_COUNTERS}) or die "open: $!";
+sub put { my ($ofs, $data) = @_; seek($f, $ofs, 0); print $f $data; }
+put(12, pack("L", 1));                # count
+put(64, pack("a48", "work"));         # name
+put(64 + 56, pack("Q", 42));          # value
+put(64 + 48, pack("L", 1));           # ready
+close($f);
+select(undef, undef, undef, 0.35);
+'
+out=$(thermobench -O - -s/dev/null --counters --column=work -p 100 -- perl -e "$publish" 2>/dev/null)
+ok $? "exit code"
+is "$(sed -ne 2p <<<$out)" "time/ms,work" "header"
+okx grep -qE '^[0-9.]+,42$' <<<$out
+
+out=$(thermobench -O - -s/dev/null --stdout -- sh -c 'echo ${THERMOBENCH_COUNTERS-unset}' 2>/dev/null)
+is "$(tail -n1 <<<$out | cut -d, -f2)" "unset" "no counters without --counters"
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 10
+
+printf 'a=1\nCPU0_work_done=5\nCPU1_work_done=7\nfoo=3\n' > column-pattern.in
+
+# Matching keys get their own columns in the order of appearance
+out=$(thermobench -O column-pattern.csv -s/dev/null --column=a '--column=CPU*_work_done' -- cat column-pattern.in 2>&1)
+ok $? "exit code"
+readarray -t lines < column-pattern.csv
+is "${lines[1]}" "time/ms,a,CPU0_work_done,CPU1_work_done" "header rewritten at close"
+like "${lines[-1]}" "^[0-9.]+,1,5,7$" "values of created columns"
+okx grep -q '^# column 3: CPU1_work_done$' column-pattern.csv
+
+# With standard output, the header cannot be rewritten
+out=$(thermobench -O - -s/dev/null '--column=CPU?_work_done' -- cat column-pattern.in 2>/dev/null)
+is "$(sed -ne 2p <<<$out)" "time/ms" "header without created columns"
+is "$(grep '^# column' <<<$out | tr '\n' ' ')" "# column 1: CPU0_work_done # column 2: CPU1_work_done " "columns announced"
+
+# The long format lists the created columns
+out=$(thermobench -O - --format=long -s/dev/null '--column=[a-f]*' -- cat column-pattern.in 2>/dev/null)
+is "$(grep '^# column' <<<$out | tr '\n' ' ')" "# column 1: a # column 2: foo " "long format"
+like "$(tail -n1 <<<$out)" "^[0-9.]+,2,3$" "long format value"
+
+# Rows written before a column was created are padded to the header
+thermobench -O column-pattern.csv -s/dev/null --column=a '--column=CPU*_x' -- \
+            sh -c 'echo a=1; sleep 0.2; echo CPU0_x=5; sleep 0.2; echo CPU1_x=7' 2>/dev/null
+is "$(sed -ne 2p column-pattern.csv)" "time/ms,a,CPU0_x,CPU1_x" "header of late columns"
+is "$(grep -v '^#' column-pattern.csv | awk -F, '{ print NF }' | sort -u)" 4 "all rows as wide as the header"
+
+rm -f column-pattern.in column-pattern.csv
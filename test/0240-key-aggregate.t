@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 11
+
+printf 'a=1\nb=x\na=2\nb=5\na=3\nb=7\na=4\n' > key-aggregate.in
+
+# All lines are read at once, so they belong to the same period
+out=$(thermobench -O - -s/dev/null --period=200 --column=a:sum --column=b:max '--column=c*:count' -- \
+                  sh -c 'cat key-aggregate.in; sleep 0.3' 2>/dev/null)
+ok $? "exit code"
+is "$(sed -ne 2p <<<$out)" "time/ms,a_sum,b_max" "header"
+okx grep -qE '^[0-9.]+,10,7$' <<<$out
+# Aggregated values are not stored immediately
+is "$(grep -c '^[0-9.]*,[0-9]' <<<$out)" 1 "one row per period"
+
+out=$(thermobench -O - -s/dev/null --period=200 --exec='(a:mean=,b:last=,other:count)sh -c "cat key-aggregate.in; echo 42"' -- \
+                  sleep 0.3 2>/dev/null)
+ok $? "exit code"
+is "$(sed -ne 2p <<<$out)" "time/ms,a_mean,b_last,other_count" "exec header"
+okx grep -qE '^[0-9.]+,2.5,7,1$' <<<$out
+
+# Text values aggregated by last are escaped
+out=$(thermobench -O - -s/dev/null --period=200 --column=t:last -- \
+                  sh -c 'echo "t=a,b"; sleep 0.3' 2>/dev/null)
+okx grep -qE '^[0-9.]+,"a,b"$' <<<$out
+
+# Colons not followed by a function name are part of the key
+out=$(thermobench -O - -s/dev/null --column=host:temp --exec='(dev:0=)echo dev:0=3' -- echo host:temp=5 2>/dev/null)
+ok $? "exit code"
+is "$(sed -ne 2p <<<$out)" "time/ms,host:temp,dev:0" "colons in keys"
+okx grep -qE '^[0-9.]+,5,$' <<<$out
+
+rm -f key-aggregate.in
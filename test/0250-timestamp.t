@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 8
+
+# Print values with timestamps 100 ms before printing them
+prog='sleep 0.2; $t = clock_gettime(CLOCK_MONOTONIC) - 0.1;
+      printf "k\@%d=1\nj\@%d=2\nk=3\n", $t * 1e9, $t * 1e9'
+out=$(thermobench -O - -s/dev/null --column=k --column=j --capture=timestamp.cap -- \
+                  perl -MTime::HiRes=clock_gettime,CLOCK_MONOTONIC,sleep -e "$prog" 2>/dev/null)
+ok $? "exit code"
+is "$(sed -ne 2p <<<$out)" "time/ms,k,j" "header"
+okx grep -q '^# column 3: recv_time/ms$' <<<$out
+# Lines with the same timestamp are merged into one row with the
+# receive time
+row=$(grep '^[0-9.]*,1,2,' <<<$out)
+ok $(awk -F, '{ d = $4 - $1; print (d >= 90 && d < 1000) ? 0 : 1 }' <<<$row) "time from the timestamp: $row"
+# The line without the timestamp uses the receive time
+like "$(tail -n1 <<<$out)" "^$(cut -d, -f4 <<<$row),3,,$" "receive time"
+
+replay=$(thermobench -O - -s/dev/null --column=k --column=j --replay=timestamp.cap 2>/dev/null)
+is "$(grep -v '^#' <<<$replay)" "$(grep -v '^#' <<<$out)" "replay"
+
+# A row with a timestamp printed after a later row goes to the window
+# of its time
+prog='$| = 1; print "k=0\n"; sleep 1.5; $t = clock_gettime(CLOCK_MONOTONIC) - 0.7;
+      printf "k=3\nk\@%d=1\n", $t * 1e9'
+out=$(thermobench -O - -s/dev/null --column=k --window=1000 --aggregate=k=sum,count -- \
+                  perl -MTime::HiRes=clock_gettime,CLOCK_MONOTONIC,sleep -e "$prog" 2>/dev/null)
+ok $? "exit code"
+is "$(grep -v '^#' <<<$out | tail -n +2 | cut -d, -f1-3)" "0,1,2
+1000,3,1" "late row in its own window"
+
+rm -f timestamp.cap
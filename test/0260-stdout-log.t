@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 8
+
+prog='seq 20000 | sed "s/^/k=/"; echo done'
+
+# Without parsing, the data is only spliced to the log
+out=$(thermobench -O - -s/dev/null --stdout-log=stdout-log.txt -- sh -c "$prog" 2>/dev/null)
+ok $? "exit code"
+is "$(sh -c "$prog" | cmp - stdout-log.txt && echo same)" "same" "log equals stdout"
+is "$(head -n1 stdout-log.txt.idx)" "time/ms,offset" "index header"
+like "$(sed -ne 2p stdout-log.txt.idx)" "^[0-9.]+,0$" "first index record"
+
+# With parsing, the data is duplicated
+out=$(thermobench -O - -s/dev/null --column=k --stdout-log=stdout-log.txt -- sh -c "$prog" 2>/dev/null)
+ok $? "exit code"
+is "$(sh -c "$prog" | cmp - stdout-log.txt && echo same)" "same" "log equals stdout"
+is "$(grep -c '^[0-9.]*,[0-9]*$' <<<$out)" 20000 "all values parsed"
+
+thermobench -O /dev/null -s/dev/null --stdout-log=stdout-log.txt --replay=/dev/null 2>/dev/null
+is $? 64 "--replay rejected"
+
+rm -f stdout-log.txt stdout-log.txt.idx
@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+. testlib
+plan_tests 10
+
+# By default, the first exit terminates the other commands
+out=$(thermobench -O - -s/dev/null --column=a --column=m_a --corun='(m)echo a=2' -- sh -c 'sleep 2; echo a=1')
+ok $? "exit code"
+okx grep -qE '^[0-9.]+,,2$' <<<$out
+is "$(grep -c ',1,' <<<$out)" 0 "COMMAND terminated"
+
+out=$(thermobench -O - -s/dev/null --wait-all --column=a --column=m_a --corun='(m)sleep 0.2; echo a=2' -- echo a=1)
+okx grep -qE '^[0-9.]+,1,$' <<<$out
+okx grep -qE '^[0-9.]+,,2$' <<<$out
+
+out=$(thermobench -O - -s/dev/null --wait-all --stdout --corun='(m)echo hello' -- true)
+okx grep -qE '^[0-9.]+,m: hello$' <<<$out
+
+prog='sed -n "s/Cpus_allowed_list:\s*/cpus=/p" /proc/self/status'
+out=$(thermobench -O - -s/dev/null --wait-all --affinity=0 --column=cpus --column=m_cpus --corun="(m@0)$prog" -- sh -c "$prog")
+okx grep -qE '^[0-9.]+,0,$' <<<$out
+okx grep -qE '^[0-9.]+,,0$' <<<$out
+
+# Counters of CMD would end up in columns of COMMAND
+out=$(thermobench -O - -s/dev/null --counters --wait-all --column=m_env \
+                  --corun='(m)echo env=${THERMOBENCH_COUNTERS-unset}' -- true 2>/dev/null)
+okx grep -qE '^[0-9.]+,unset$' <<<$out
+
+thermobench -O /dev/null -s/dev/null --corun='(m-1)true' -- true 2>/dev/null
+is $? 1 "invalid PREFIX rejected"